@@ -0,0 +1,86 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdalign.h>
+
+#include "arena.h"
+
+#define ARENA_ALIGN alignof(max_align_t)
+
+_Static_assert(offsetof(ArenaBlock, data) % ARENA_ALIGN == 0, "arena data must start aligned for any type");
+
+static size_t align_up(size_t n) {
+    return (n + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+}
+
+Arena arena_new(size_t block_size) {
+    Arena ret = {
+        .head = NULL,
+        .block_size = block_size ? block_size : ARENA_DEFAULT_BLOCK_SIZE
+    };
+    return ret;
+}
+
+static ArenaBlock* arena_add_block(Arena* arena, size_t min_size) {
+    size_t size = arena->block_size;
+    if (size < min_size) size = min_size;
+    ArenaBlock* block = malloc(sizeof(ArenaBlock) + size);
+    if (block) {
+        block->next = arena->head;
+        block->size = size;
+        block->used = 0;
+        arena->head = block;
+    }
+    return block;
+}
+
+void* arena_alloc(Arena* arena, size_t size) {
+    size = align_up(size ? size : 1);
+    ArenaBlock* block = arena->head;
+    if (!block || block->size - block->used < size) {
+        // oversized requests get a block of their own, everything else starts a fresh block
+        block = arena_add_block(arena, size);
+        if (!block) return NULL;
+    }
+    void* ret = &block->data[block->used];
+    block->used += size;
+    return ret;
+}
+
+void* arena_realloc(Arena* arena, void* ptr, size_t old_size, size_t new_size) {
+    if (!ptr) return arena_alloc(arena, new_size);
+
+    ArenaBlock* block = arena->head;
+    size_t old_aligned = align_up(old_size ? old_size : 1);
+    size_t new_aligned = align_up(new_size ? new_size : 1);
+    if (block && (char*) ptr + old_aligned == &block->data[block->used]) {
+        size_t start = (char*) ptr - block->data;
+        if (block->size - start >= new_aligned) {
+            block->used = start + new_aligned;
+            return ptr;
+        }
+    }
+    if (new_size <= old_size) return ptr;
+
+    void* ret = arena_alloc(arena, new_size);
+    if (ret) memcpy(ret, ptr, old_size);
+    return ret;
+}
+
+char* arena_strndup(Arena* arena, const char* str, size_t len) {
+    char* ret = arena_alloc(arena, len + 1);
+    if (ret) {
+        memcpy(ret, str, len);
+        ret[len] = '\0';
+    }
+    return ret;
+}
+
+void arena_free(Arena* arena) {
+    ArenaBlock* block = arena->head;
+    while (block) {
+        ArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->head = NULL;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdalign.h>
+
+#define ARENA_DEFAULT_BLOCK_SIZE (64 * 1024)
+
+// One large malloc'd block. Allocations are bumped out of data[] until it is full. data[]
+// starts on a max_align_t boundary and used only moves in multiples of it, so every
+// allocation does too.
+typedef struct arena_block {
+    struct arena_block* next;
+    size_t size;
+    size_t used;
+    alignas(max_align_t) char data[];
+} ArenaBlock;
+
+// A bump allocator: many small allocations are carved out of a few large blocks and
+// all of them are released together by arena_free.
+typedef struct arena {
+    ArenaBlock* head;
+    size_t block_size;
+} Arena;
+
+// Creates an empty arena. No memory is allocated until the first arena_alloc.
+// block_size of 0 selects ARENA_DEFAULT_BLOCK_SIZE.
+Arena arena_new(size_t block_size);
+
+// Returns size bytes aligned for any type, or NULL if malloc fails.
+void* arena_alloc(Arena* arena, size_t size);
+
+// Resizes the allocation at ptr (old_size bytes) to new_size. Grows in place when ptr was
+// the last allocation and the block has room, otherwise copies. Returns NULL on failure.
+void* arena_realloc(Arena* arena, void* ptr, size_t old_size, size_t new_size);
+
+// Copies len bytes of str into the arena and null terminates them. Returns NULL on failure.
+char* arena_strndup(Arena* arena, const char* str, size_t len);
+
+// Releases every block owned by the arena. The arena can be reused afterwards.
+void arena_free(Arena* arena);
@@ -0,0 +1,272 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+#include "async_read.h"
+
+// The rings of one io_uring, mapped from the kernel. There is no liburing here, so this is
+// the minimal subset of it the reader needs.
+struct uring {
+    int fd;
+    void* sq_ptr;
+    size_t sq_len;
+    void* cq_ptr;
+    size_t cq_len;
+    struct io_uring_sqe* sqes;
+    size_t sqes_len;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_cqe* cqes;
+};
+
+// One read buffer. Slots are reused round robin, so slot i always holds chunk i mod depth.
+struct read_slot {
+    char* buf;
+    struct iovec iov;
+    uint64_t offset;
+    size_t len;
+    int done;
+    int res;
+};
+
+static int uring_setup(struct uring* ring, unsigned entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0) return -1;
+
+    ring->sq_len = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_len = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_len > ring->sq_len) ring->sq_len = ring->cq_len;
+        ring->cq_len = ring->sq_len;
+    }
+    ring->sq_ptr = mmap(NULL, ring->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ptr == MAP_FAILED) {
+        close(ring->fd);
+        return -1;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ptr = ring->sq_ptr;
+    }
+    else {
+        ring->cq_ptr = mmap(NULL, ring->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ptr == MAP_FAILED) {
+            munmap(ring->sq_ptr, ring->sq_len);
+            close(ring->fd);
+            return -1;
+        }
+    }
+    ring->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        if (ring->cq_ptr != ring->sq_ptr) munmap(ring->cq_ptr, ring->cq_len);
+        munmap(ring->sq_ptr, ring->sq_len);
+        close(ring->fd);
+        return -1;
+    }
+
+    char* sq = ring->sq_ptr;
+    char* cq = ring->cq_ptr;
+    ring->sq_head = (unsigned*) (sq + params.sq_off.head);
+    ring->sq_tail = (unsigned*) (sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned*) (sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned*) (sq + params.sq_off.array);
+    ring->cq_head = (unsigned*) (cq + params.cq_off.head);
+    ring->cq_tail = (unsigned*) (cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned*) (cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*) (cq + params.cq_off.cqes);
+    return 0;
+}
+
+static void uring_free(struct uring* ring) {
+    munmap(ring->sqes, ring->sqes_len);
+    if (ring->cq_ptr != ring->sq_ptr) munmap(ring->cq_ptr, ring->cq_len);
+    munmap(ring->sq_ptr, ring->sq_len);
+    close(ring->fd);
+}
+
+// Queues a readv of slot into the submission ring. It is handed to the kernel by uring_enter.
+static void uring_queue_read(struct uring* ring, int fd, struct read_slot* slot, uint64_t user_data) {
+    unsigned tail = *ring->sq_tail;
+    unsigned idx = tail & *ring->sq_mask;
+    struct io_uring_sqe* sqe = &ring->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READV;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t) (uintptr_t) &slot->iov;
+    sqe->len = 1;
+    sqe->off = slot->offset;
+    sqe->user_data = user_data;
+    ring->sq_array[idx] = idx;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+static int uring_enter(struct uring* ring, unsigned to_submit, unsigned min_complete) {
+    int ret;
+    do {
+        ret = syscall(__NR_io_uring_enter, ring->fd, to_submit, min_complete, IORING_ENTER_GETEVENTS, NULL, 0);
+    } while (ret < 0 && errno == EINTR);
+    return ret;
+}
+
+// Marks every completed read's slot done. Returns how many completions were reaped.
+static unsigned uring_reap(struct uring* ring, struct read_slot* slots, int depth) {
+    unsigned reaped = 0;
+    unsigned head = *ring->cq_head;
+    while (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+        struct io_uring_cqe* cqe = &ring->cqes[head & *ring->cq_mask];
+        struct read_slot* slot = &slots[cqe->user_data % depth];
+        slot->res = cqe->res;
+        slot->done = 1;
+        head++;
+        reaped++;
+    }
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    return reaped;
+}
+
+static int open_file(const char* filename, uint64_t* size) {
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) return -1;
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return -1;
+    }
+    *size = st.st_size;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    return fd;
+}
+
+// Reads whatever part of [offset, offset + len) is still missing after a short read.
+static int pread_full(int fd, char* buf, size_t len, uint64_t offset, size_t done) {
+    while (done < len) {
+        ssize_t ret = pread(fd, buf + done, len - done, offset + done);
+        if (ret < 0 && errno == EINTR) continue;
+        if (ret <= 0) return -1;
+        done += ret;
+    }
+    return 0;
+}
+
+int pread_file(const char* filename, size_t chunk_size, chunk_consumer consumer, void* ctx) {
+    uint64_t size;
+    if (chunk_size == 0) chunk_size = ASYNC_READ_CHUNK_SIZE;
+    int fd = open_file(filename, &size);
+    if (fd == -1) return -1;
+    char* buf = malloc(chunk_size);
+    if (!buf) {
+        close(fd);
+        return -1;
+    }
+    int ret = 0;
+    for (uint64_t offset = 0; offset < size && ret == 0; offset += chunk_size) {
+        size_t len = (size - offset < chunk_size) ? size - offset : chunk_size;
+        if (pread_full(fd, buf, len, offset, 0) != 0) ret = -1;
+        else ret = consumer(buf, len, offset, ctx);
+    }
+    free(buf);
+    close(fd);
+    return ret;
+}
+
+int async_read_uses_io_uring() {
+    struct uring ring;
+    if (uring_setup(&ring, 1) != 0) return 0;
+    uring_free(&ring);
+    return 1;
+}
+
+int async_read_file(const char* filename, size_t chunk_size, int depth, chunk_consumer consumer, void* ctx) {
+    if (chunk_size == 0) chunk_size = ASYNC_READ_CHUNK_SIZE;
+    if (depth <= 0) depth = ASYNC_READ_DEPTH;
+
+    struct uring ring;
+    if (uring_setup(&ring, depth) != 0) return pread_file(filename, chunk_size, consumer, ctx);
+
+    uint64_t size;
+    int fd = open_file(filename, &size);
+    if (fd == -1) {
+        uring_free(&ring);
+        return -1;
+    }
+    struct read_slot* slots = calloc(depth, sizeof(struct read_slot));
+    char* buffers = malloc((size_t) depth * chunk_size);
+    if (!slots || !buffers) {
+        free(slots);
+        free(buffers);
+        close(fd);
+        uring_free(&ring);
+        return -1;
+    }
+
+    uint64_t chunk_count = (size + chunk_size - 1) / chunk_size;
+    uint64_t next_submit = 0;  // next chunk to put in flight
+    uint64_t next_deliver = 0; // next chunk the consumer gets
+    unsigned queued = 0;
+    unsigned in_flight = 0;
+    int ret = 0;
+
+    while (next_deliver < chunk_count && ret == 0) {
+        // keep every free slot busy with the next chunk of the file
+        while (next_submit < chunk_count && next_submit < next_deliver + depth) {
+            struct read_slot* slot = &slots[next_submit % depth];
+            slot->buf = &buffers[(next_submit % depth) * chunk_size];
+            slot->offset = next_submit * chunk_size;
+            slot->len = (size - slot->offset < chunk_size) ? size - slot->offset : chunk_size;
+            slot->iov.iov_base = slot->buf;
+            slot->iov.iov_len = slot->len;
+            slot->done = 0;
+            uring_queue_read(&ring, fd, slot, next_submit);
+            queued++;
+            in_flight++;
+            next_submit++;
+        }
+
+        // wait for at least one completion only if the chunk we need next isn't in yet
+        struct read_slot* want = &slots[next_deliver % depth];
+        if (uring_enter(&ring, queued, want->done ? 0 : 1) < 0) {
+            ret = -1;
+            break;
+        }
+        queued = 0;
+
+        in_flight -= uring_reap(&ring, slots, depth);
+
+        while (next_deliver < next_submit && slots[next_deliver % depth].done && ret == 0) {
+            struct read_slot* slot = &slots[next_deliver % depth];
+            if (slot->res < 0 || pread_full(fd, slot->buf, slot->len, slot->offset, slot->res) != 0) {
+                ret = -1;
+                break;
+            }
+            ret = consumer(slot->buf, slot->len, slot->offset, ctx);
+            slot->done = 0;
+            next_deliver++;
+        }
+    }
+
+    // reads still in flight write into buffers, so they have to land before those are freed
+    while (in_flight > 0 && uring_enter(&ring, 0, 1) >= 0) {
+        in_flight -= uring_reap(&ring, slots, depth);
+    }
+
+    free(buffers);
+    free(slots);
+    close(fd);
+    uring_free(&ring);
+    return ret;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ASYNC_READ_CHUNK_SIZE (1024 * 1024)
+#define ASYNC_READ_DEPTH 8
+
+// Called once per chunk, in file order. chunk is only valid until the callback returns.
+// Returning non zero stops the read.
+typedef int (*chunk_consumer)(const char* chunk, size_t len, uint64_t offset, void* ctx);
+
+// Reads filename in chunk_size pieces with up to depth reads in flight on an io_uring and
+// hands each chunk to consumer as soon as it and every chunk before it have arrived, so the
+// consumer runs while the next reads are still in progress. Falls back to a plain pread loop
+// when io_uring is not available. chunk_size and depth of 0 select the defaults above.
+// Returns 0 on success, -1 on an I/O error, or the consumer's non zero return value.
+int async_read_file(const char* filename, size_t chunk_size, int depth, chunk_consumer consumer, void* ctx);
+
+// Same, but never uses io_uring. Mostly for benchmarking the two paths against each other.
+int pread_file(const char* filename, size_t chunk_size, chunk_consumer consumer, void* ctx);
+
+// Whether io_uring could be set up on this system (it is often disabled in containers).
+int async_read_uses_io_uring();
@@ -0,0 +1,296 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "string_utils.h"
+#include "stream_tokenizer.h"
+
+/*
+   Microbenchmarks for string_utils. Every case runs over synthetic inputs from 1 KB up to
+   BENCH_MAX_SIZE, once with short lines and once with long lines, and prints one CSV row
+   per (function, size, line length):
+
+       function,bytes,line_len,reps,ns_per_byte,mb_per_s,allocs,alloc_bytes
+
+   ns_per_byte and mb_per_s come from the median repetition, allocs and alloc_bytes are per
+   run. Most of these functions are quadratic, so once a case takes longer than the time
+   budget its larger sizes are skipped (noted on stderr).
+
+   Usage: ./string_bench [max_bytes] [budget_seconds]
+*/
+
+#define BENCH_MIN_SIZE 1024UL
+#define BENCH_MAX_SIZE (1024UL * 1024 * 1024)
+#define BENCH_SIZE_STEP 4
+#define BENCH_SHORT_LINE 16
+#define BENCH_LONG_LINE 4096
+#define BENCH_MIN_REPS 3
+#define BENCH_MAX_REPS 50
+#define BENCH_REP_TIME 0.25
+#define BENCH_BUDGET 2.0
+
+// glibc lets a program replace malloc. Counting here also catches the allocations made
+// inside strdup, getline and friends.
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t n, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+extern void __libc_free(void* ptr);
+
+static size_t alloc_calls = 0;
+static size_t alloc_bytes = 0;
+
+void* malloc(size_t size) {
+    alloc_calls++;
+    alloc_bytes += size;
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t n, size_t size) {
+    alloc_calls++;
+    alloc_bytes += n * size;
+    return __libc_calloc(n, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+    alloc_calls++;
+    alloc_bytes += size;
+    return __libc_realloc(ptr, size);
+}
+
+void free(void* ptr) {
+    __libc_free(ptr);
+}
+
+struct bench_input {
+    char* data;  // size bytes of text split into '\n' terminated lines of line_len
+    size_t size;
+    size_t line_len;
+    char* path;  // the same text written to a temporary file
+};
+
+typedef void (*bench_fn)(struct bench_input* input);
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void run_lazy_append(struct bench_input* input) {
+    char* str = strdup("");
+    for (size_t i = 0; str && i < input->size; i += input->line_len) {
+        size_t end = i + input->line_len < input->size ? i + input->line_len : input->size;
+        char saved = input->data[end];
+        input->data[end] = '\0';
+        String ret = lazy_append_to_string(str, &input->data[i]);
+        input->data[end] = saved;
+        str = ret.ptr;
+    }
+    free(str);
+}
+
+static void run_append(struct bench_input* input) {
+    char* str = strdup("");
+    size_t len = 0;
+    for (size_t i = 0; str && i < input->size; i += input->line_len) {
+        size_t end = i + input->line_len < input->size ? i + input->line_len : input->size;
+        char saved = input->data[end];
+        input->data[end] = '\0';
+        String ret = append_to_string(str, &input->data[i], len, end - i);
+        input->data[end] = saved;
+        str = ret.ptr;
+        len += end - i;
+    }
+    free(str);
+}
+
+static void run_tokenize(struct bench_input* input) {
+    size_t index = 0;
+    char* token;
+    while ((token = tokenize_string(input->data, '\n', &index))) {
+        free(token);
+    }
+}
+
+static void run_split(struct bench_input* input) {
+    size_t count = 0;
+    char** lines = split_on_delim(input->data, &count, '\n');
+    if (lines) {
+        for (size_t i = 0; i < count; i++) free(lines[i]);
+    }
+    free(lines);
+}
+
+static void run_split_parallel(struct bench_input* input) {
+    Arena arena = arena_new(input->size + ARENA_DEFAULT_BLOCK_SIZE);
+    size_t count = 0;
+    split_on_delim_parallel(&arena, input->data, input->size, &count, '\n');
+    arena_free(&arena);
+}
+
+// arena_alloc promises memory aligned for any type, whatever sizes came before. Checked
+// once before anything built on it is timed.
+static int arena_aligned(void) {
+    Arena arena = arena_new(256);
+    int ok = 1;
+    for (size_t size = 0; ok && size < 1000; size += 7) {
+        char* ptr = arena_alloc(&arena, size);
+        ok = ptr && (uintptr_t) ptr % alignof(max_align_t) == 0;
+        if (ok && size % 2) {
+            ptr = arena_realloc(&arena, ptr, size, size * 3);
+            ok = ptr && (uintptr_t) ptr % alignof(max_align_t) == 0;
+        }
+    }
+    arena_free(&arena);
+    return ok;
+}
+
+static int count_token(const char* token, size_t len, int partial, void* ctx) {
+    (void) token;
+    (void) len;
+    if (!partial) *(size_t*) ctx += 1;
+    return 0;
+}
+
+static void run_stream_tokenize(struct bench_input* input) {
+    int fd = open(input->path, O_RDONLY);
+    if (fd == -1) return;
+    size_t count = 0;
+    stream_tokenize(fd, '\n', 0, count_token, &count);
+    close(fd);
+}
+
+static void run_read_string(struct bench_input* input) {
+    // read_string always reads stdin, so point stdin at the input file for the run
+    if (!freopen(input->path, "r", stdin)) return;
+    free(read_string('\x01'));
+}
+
+static void run_file_into_str(struct bench_input* input) {
+    free(file_into_str(input->path));
+}
+
+struct bench_case {
+    const char* name;
+    bench_fn fn;
+    size_t skip_from_size[2]; // per line length, first size that is over the time budget
+};
+
+static int make_input(struct bench_input* input, size_t size, size_t line_len) {
+    input->size = size;
+    input->line_len = line_len;
+    input->data = malloc(size + 1);
+    if (!input->data) return -1;
+    for (size_t i = 0; i < size; i++) {
+        input->data[i] = (i % line_len == line_len - 1) ? '\n' : 'a' + (i % 26);
+    }
+    input->data[size] = '\0';
+
+    char path[] = "/tmp/string_bench_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd == -1) {
+        free(input->data);
+        return -1;
+    }
+    size_t written = 0;
+    while (written < size) {
+        ssize_t ret = write(fd, &input->data[written], size - written);
+        if (ret <= 0) break;
+        written += ret;
+    }
+    close(fd);
+    input->path = strdup(path);
+    return written == size ? 0 : -1;
+}
+
+static void free_input(struct bench_input* input) {
+    unlink(input->path);
+    free(input->path);
+    free(input->data);
+}
+
+static int compare_double(const void* a, const void* b) {
+    double x = *(const double*) a, y = *(const double*) b;
+    return (x > y) - (x < y);
+}
+
+// Runs one warmup and then repetitions until BENCH_REP_TIME has passed. Returns the
+// median time of a run in seconds.
+static double bench_run(bench_fn fn, struct bench_input* input, int* reps, size_t* calls, size_t* bytes) {
+    double times[BENCH_MAX_REPS];
+    size_t calls_before = alloc_calls, bytes_before = alloc_bytes;
+    fn(input);
+    *calls = alloc_calls - calls_before;
+    *bytes = alloc_bytes - bytes_before;
+
+    double start = now();
+    int n = 0;
+    while (n < BENCH_MAX_REPS && (n < BENCH_MIN_REPS || now() - start < BENCH_REP_TIME)) {
+        double t = now();
+        fn(input);
+        times[n++] = now() - t;
+    }
+    qsort(times, n, sizeof(double), compare_double);
+    *reps = n;
+    return times[n / 2];
+}
+
+int main(int argc, char* argv[]) {
+    size_t max_size = argc > 1 ? strtoull(argv[1], NULL, 10) : BENCH_MAX_SIZE;
+    double budget = argc > 2 ? atof(argv[2]) : BENCH_BUDGET;
+    size_t line_lens[] = { BENCH_SHORT_LINE, BENCH_LONG_LINE };
+
+    struct bench_case cases[] = {
+        { "lazy_append_to_string", run_lazy_append, { 0, 0 } },
+        { "append_to_string", run_append, { 0, 0 } },
+        { "tokenize_string", run_tokenize, { 0, 0 } },
+        { "split_on_delim", run_split, { 0, 0 } },
+        { "split_on_delim_parallel", run_split_parallel, { 0, 0 } },
+        { "stream_tokenize", run_stream_tokenize, { 0, 0 } },
+        { "read_string", run_read_string, { 0, 0 } },
+        { "file_into_str", run_file_into_str, { 0, 0 } },
+    };
+    size_t case_count = sizeof(cases) / sizeof(cases[0]);
+
+    if (!arena_aligned()) {
+        fprintf(stderr, "arena_alloc returned memory not aligned to alignof(max_align_t)\n");
+        return 1;
+    }
+    printf("function,bytes,line_len,reps,ns_per_byte,mb_per_s,allocs,alloc_bytes\n");
+    for (size_t size = BENCH_MIN_SIZE; size <= max_size; size *= BENCH_SIZE_STEP) {
+        for (size_t l = 0; l < 2; l++) {
+            int needed = 0;
+            for (size_t c = 0; c < case_count; c++) {
+                if (!cases[c].skip_from_size[l]) needed = 1;
+            }
+            if (!needed) continue;
+
+            struct bench_input input;
+            if (make_input(&input, size, line_lens[l]) != 0) {
+                fprintf(stderr, "could not build a %zu byte input\n", size);
+                return 1;
+            }
+            for (size_t c = 0; c < case_count; c++) {
+                if (cases[c].skip_from_size[l]) continue;
+                int reps;
+                size_t calls, bytes;
+                double t = bench_run(cases[c].fn, &input, &reps, &calls, &bytes);
+                printf("%s,%zu,%zu,%d,%.3f,%.1f,%zu,%zu\n", cases[c].name, size, line_lens[l], reps,
+                       t * 1e9 / size, size / t / 1e6, calls, bytes);
+                fflush(stdout);
+                if (t * BENCH_SIZE_STEP > budget) {
+                    cases[c].skip_from_size[l] = size * BENCH_SIZE_STEP;
+                    fprintf(stderr, "%s (line_len %zu): skipping sizes from %zu, over the %.1fs budget\n",
+                            cases[c].name, line_lens[l], size * BENCH_SIZE_STEP, budget);
+                }
+            }
+            free_input(&input);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,51 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "lmc.h"
+
+/*
+   Build-time generator for opcode_hash.h. Searches for a seed for which opcode_hash()
+   sends every mnemonic in opcodes[] to a different slot of a power-of-two table, then
+   prints that table. The parser can then resolve a token with one hash and one compare.
+*/
+
+#define TABLE_SIZE 16
+#define MAX_SEED 1000000
+
+int main() {
+    signed char table[TABLE_SIZE];
+    size_t min_len = (size_t) -1;
+    size_t max_len = 0;
+
+    for (int i = 0; i < opcode_count; i++) {
+        size_t len = strlen(opcodes[i]);
+        if (len < min_len) min_len = len;
+        if (len > max_len) max_len = len;
+    }
+
+    for (unsigned int seed = 0; seed < MAX_SEED; seed++) {
+        memset(table, -1, sizeof(table));
+        int i;
+        for (i = 0; i < opcode_count; i++) {
+            unsigned int slot = opcode_hash(seed, opcodes[i], strlen(opcodes[i])) & (TABLE_SIZE - 1);
+            if (table[slot] != -1) break;
+            table[slot] = i;
+        }
+        if (i < opcode_count) continue;
+
+        printf("// Generated by gen_opcode_hash, do not edit.\n");
+        printf("#pragma once\n\n");
+        printf("#define OPCODE_HASH_SEED %uu\n", seed);
+        printf("#define OPCODE_HASH_SIZE %d\n", TABLE_SIZE);
+        printf("#define OPCODE_MIN_LEN %zu\n", min_len);
+        printf("#define OPCODE_MAX_LEN %zu\n\n", max_len);
+        printf("static const signed char opcode_hash_table[OPCODE_HASH_SIZE] = {\n   ");
+        for (int slot = 0; slot < TABLE_SIZE; slot++) {
+            printf(" %d%s", table[slot], slot == TABLE_SIZE - 1 ? "" : ",");
+        }
+        printf("\n};\n");
+        return 0;
+    }
+    fprintf(stderr, "gen_opcode_hash: no perfect hash found below seed %d\n", MAX_SEED);
+    return 1;
+}
@@ -0,0 +1,115 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "intern.h"
+
+#define INTERN_MIN_SLOTS 16
+
+// FNV-1a
+static uint32_t intern_hash(const char* str, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char) str[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+int intern_init(InternTable* table, size_t expected) {
+    size_t slots = INTERN_MIN_SLOTS;
+    while (slots < expected * 2) slots *= 2;
+    table->arena = arena_new(0);
+    table->slots = calloc(slots, sizeof(uint32_t));
+    table->hashes = NULL;
+    table->strings = NULL;
+    table->lens = NULL;
+    table->count = 0;
+    table->slot_count = slots;
+    table->id_cap = 0;
+    return table->slots ? 0 : -1;
+}
+
+// Returns the slot holding str, or the empty slot it would go in.
+static size_t intern_find(const InternTable* table, const char* str, size_t len, uint32_t hash) {
+    size_t mask = table->slot_count - 1;
+    size_t slot = hash & mask;
+    while (table->slots[slot]) {
+        uint32_t id = table->slots[slot] - 1;
+        if (table->hashes[id] == hash && table->lens[id] == len && memcmp(table->strings[id], str, len) == 0) {
+            return slot;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+static int intern_grow(InternTable* table) {
+    size_t slot_count = table->slot_count * 2;
+    uint32_t* slots = calloc(slot_count, sizeof(uint32_t));
+    if (!slots) return -1;
+    for (size_t id = 0; id < table->count; id++) {
+        size_t slot = table->hashes[id] & (slot_count - 1);
+        while (slots[slot]) slot = (slot + 1) & (slot_count - 1);
+        slots[slot] = id + 1;
+    }
+    free(table->slots);
+    table->slots = slots;
+    table->slot_count = slot_count;
+    return 0;
+}
+
+int intern_lookup(const InternTable* table, const char* str, size_t len) {
+    size_t slot = intern_find(table, str, len, intern_hash(str, len));
+    return table->slots[slot] ? (int) table->slots[slot] - 1 : -1;
+}
+
+int intern(InternTable* table, const char* str, size_t len) {
+    uint32_t hash = intern_hash(str, len);
+    size_t slot = intern_find(table, str, len, hash);
+    if (table->slots[slot]) return table->slots[slot] - 1;
+
+    // keep the load factor at or below one half
+    if ((table->count + 1) * 2 > table->slot_count) {
+        if (intern_grow(table) != 0) return -1;
+        slot = intern_find(table, str, len, hash);
+    }
+    if (table->count == table->id_cap) {
+        size_t cap = table->id_cap ? table->id_cap * 2 : INTERN_MIN_SLOTS;
+        uint32_t* hashes = realloc(table->hashes, cap * sizeof(uint32_t));
+        if (!hashes) return -1;
+        table->hashes = hashes;
+        const char** strings = realloc(table->strings, cap * sizeof(char*));
+        if (!strings) return -1;
+        table->strings = strings;
+        size_t* lens = realloc(table->lens, cap * sizeof(size_t));
+        if (!lens) return -1;
+        table->lens = lens;
+        table->id_cap = cap;
+    }
+    char* copy = arena_strndup(&table->arena, str, len);
+    if (!copy) return -1;
+
+    size_t id = table->count++;
+    table->hashes[id] = hash;
+    table->strings[id] = copy;
+    table->lens[id] = len;
+    table->slots[slot] = id + 1;
+    return id;
+}
+
+const char* intern_string(const InternTable* table, int id) {
+    return table->strings[id];
+}
+
+void intern_free(InternTable* table) {
+    arena_free(&table->arena);
+    free(table->slots);
+    free(table->hashes);
+    free(table->strings);
+    free(table->lens);
+    table->slots = NULL;
+    table->hashes = NULL;
+    table->strings = NULL;
+    table->lens = NULL;
+    table->count = 0;
+}
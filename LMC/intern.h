@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+
+// Maps each distinct string to a small integer id, handed out in insertion order from 0.
+// Two strings are equal exactly when their ids are, so lookups happen once and everything
+// after compares ints. The strings themselves are copied into an arena.
+typedef struct intern_table {
+    Arena arena;
+    uint32_t* slots;      // open addressing: id + 1 of the string in each slot, 0 if empty
+    uint32_t* hashes;     // hash of each id, so growing never rehashes the strings
+    const char** strings; // by id
+    size_t* lens;         // by id
+    size_t count;
+    size_t slot_count;    // always a power of two
+    size_t id_cap;
+} InternTable;
+
+// Returns -1 if the table can't be allocated. expected is a sizing hint and may be 0.
+int intern_init(InternTable* table, size_t expected);
+
+// Returns the id of str[0..len), adding it if it is new, or -1 if memory runs out.
+int intern(InternTable* table, const char* str, size_t len);
+
+// Returns the id of str[0..len) or -1 if it was never interned.
+int intern_lookup(const InternTable* table, const char* str, size_t len);
+
+// The interned copy of id, null terminated.
+const char* intern_string(const InternTable* table, int id);
+
+void intern_free(InternTable* table);
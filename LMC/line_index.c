@@ -0,0 +1,258 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "line_index.h"
+
+struct index_chunk {
+    const char* buf;
+    size_t begin;
+    size_t end;
+    size_t len;
+    char delim;
+    uint64_t* offsets;
+    size_t count;
+    size_t cap;
+    int failed;
+};
+
+static void* index_chunk(void* arg) {
+    struct index_chunk* chunk = arg;
+    const char* p = &chunk->buf[chunk->begin];
+    const char* end = &chunk->buf[chunk->end];
+    // a line that crosses into the next chunk needs no fix up: only the delimiter that ends
+    // it is recorded, by whichever chunk contains that delimiter
+    while ((p = memchr(p, chunk->delim, end - p))) {
+        size_t start = p - chunk->buf + 1;
+        p++;
+        if (start >= chunk->len) break;
+        if (chunk->count == chunk->cap) {
+            size_t cap = chunk->cap ? chunk->cap * 2 : 1024;
+            uint64_t* offsets = realloc(chunk->offsets, cap * sizeof(uint64_t));
+            if (!offsets) {
+                chunk->failed = 1;
+                break;
+            }
+            chunk->offsets = offsets;
+            chunk->cap = cap;
+        }
+        chunk->offsets[chunk->count++] = start;
+    }
+    return NULL;
+}
+
+int line_index_build(LineIndex* index, const char* buf, size_t len, char delim, int threads) {
+    index->offsets = NULL;
+    index->count = 0;
+    index->delim = delim;
+    index->map = NULL;
+    index->map_len = 0;
+    if (len == 0) return 0;
+
+    if (threads <= 0) threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads <= 0) threads = 1;
+    if ((size_t) threads > len / LINE_INDEX_MIN_CHUNK) threads = len / LINE_INDEX_MIN_CHUNK;
+    if (threads < 1) threads = 1;
+
+    struct index_chunk* chunks = calloc(threads, sizeof(struct index_chunk));
+    pthread_t* tids = calloc(threads, sizeof(pthread_t));
+    if (!chunks || !tids) {
+        free(chunks);
+        free(tids);
+        return -1;
+    }
+
+    size_t step = len / threads;
+    int started = 0;
+    for (int t = 0; t < threads; t++) {
+        chunks[t].buf = buf;
+        chunks[t].begin = t * step;
+        chunks[t].end = (t == threads - 1) ? len : (t + 1) * step;
+        chunks[t].len = len;
+        chunks[t].delim = delim;
+    }
+    // the calling thread takes the first chunk, and any chunk a thread could not be started for
+    for (int t = 1; t < threads; t++) {
+        if (pthread_create(&tids[t], NULL, index_chunk, &chunks[t]) != 0) break;
+        started = t;
+    }
+    index_chunk(&chunks[0]);
+    for (int t = started + 1; t < threads; t++) index_chunk(&chunks[t]);
+
+    int ret = 0;
+    size_t total = 1; // line 0 always starts at offset 0
+    for (int t = 0; t < threads; t++) {
+        if (t > 0 && t <= started) pthread_join(tids[t], NULL);
+        if (chunks[t].failed) ret = -1;
+        total += chunks[t].count;
+    }
+
+    if (ret == 0) {
+        index->offsets = malloc(total * sizeof(uint64_t));
+        if (index->offsets) {
+            index->offsets[0] = 0;
+            size_t pos = 1;
+            for (int t = 0; t < threads; t++) {
+                memcpy(&index->offsets[pos], chunks[t].offsets, chunks[t].count * sizeof(uint64_t));
+                pos += chunks[t].count;
+            }
+            index->count = total;
+        }
+        else {
+            ret = -1;
+        }
+    }
+
+    for (int t = 0; t < threads; t++) free(chunks[t].offsets);
+    free(chunks);
+    free(tids);
+    return ret;
+}
+
+size_t line_index_line_len(const LineIndex* index, const char* buf, size_t len, size_t i) {
+    size_t start = index->offsets[i];
+    if (i + 1 < index->count) return index->offsets[i + 1] - start - 1;
+    // the last line runs to the end of the buffer, minus a trailing delimiter if there is one
+    return (buf[len - 1] == index->delim) ? len - start - 1 : len - start;
+}
+
+void line_index_free(LineIndex* index) {
+    if (index->map) munmap(index->map, index->map_len);
+    else free(index->offsets);
+    index->offsets = NULL;
+    index->count = 0;
+    index->map = NULL;
+    index->map_len = 0;
+}
+
+static char* sidecar_path(const char* source_path) {
+    size_t len = strlen(source_path);
+    char* path = malloc(len + sizeof(LINE_INDEX_SUFFIX));
+    if (path) {
+        memcpy(path, source_path, len);
+        memcpy(&path[len], LINE_INDEX_SUFFIX, sizeof(LINE_INDEX_SUFFIX));
+    }
+    return path;
+}
+
+static int write_all(int fd, const void* buf, size_t len) {
+    const char* p = buf;
+    while (len) {
+        ssize_t ret = write(fd, p, len);
+        if (ret <= 0) return -1;
+        p += ret;
+        len -= ret;
+    }
+    return 0;
+}
+
+int line_index_save(const LineIndex* index, const char* source_path) {
+    struct stat st;
+    if (stat(source_path, &st) == -1) return -1;
+
+    char* path = sidecar_path(source_path);
+    if (!path) return -1;
+    char* tmp_path = malloc(strlen(path) + 8);
+    if (!tmp_path) {
+        free(path);
+        return -1;
+    }
+    sprintf(tmp_path, "%s.XXXXXX", path);
+
+    int ret = -1;
+    int fd = mkstemp(tmp_path);
+    if (fd != -1) {
+        struct line_index_header header = {
+            .magic = { 'L', 'I', 'D', 'X' },
+            .version = 1,
+            .source_size = st.st_size,
+            .source_mtime_sec = st.st_mtim.tv_sec,
+            .source_mtime_nsec = st.st_mtim.tv_nsec,
+            .count = index->count,
+            .delim = (unsigned char) index->delim
+        };
+        if (write_all(fd, &header, sizeof(header)) == 0 &&
+            write_all(fd, index->offsets, index->count * sizeof(uint64_t)) == 0 &&
+            fchmod(fd, 0644) == 0) {
+            ret = 0;
+        }
+        close(fd);
+        if (ret == 0 && rename(tmp_path, path) == -1) ret = -1;
+        if (ret == -1) unlink(tmp_path);
+    }
+    free(tmp_path);
+    free(path);
+    return ret;
+}
+
+int line_index_load(LineIndex* index, const char* source_path, char delim) {
+    struct stat src, st;
+    if (stat(source_path, &src) == -1) return -1;
+
+    char* path = sidecar_path(source_path);
+    if (!path) return -1;
+    int fd = open(path, O_RDONLY);
+    free(path);
+    if (fd == -1) return -1;
+    if (fstat(fd, &st) == -1 || (size_t) st.st_size < sizeof(struct line_index_header)) {
+        close(fd);
+        return -1;
+    }
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+
+    struct line_index_header* header = map;
+    if (memcmp(header->magic, "LIDX", 4) != 0 || header->version != 1 ||
+        header->delim != (unsigned char) delim ||
+        header->source_size != (uint64_t) src.st_size ||
+        header->source_mtime_sec != src.st_mtim.tv_sec ||
+        header->source_mtime_nsec != src.st_mtim.tv_nsec ||
+        header->count != (st.st_size - sizeof(struct line_index_header)) / sizeof(uint64_t)) {
+        munmap(map, st.st_size);
+        return -1;
+    }
+    index->offsets = (uint64_t*) (header + 1);
+    index->count = header->count;
+    index->delim = delim;
+    index->map = map;
+    index->map_len = st.st_size;
+    return 0;
+}
+
+int line_index_open(LineIndex* index, const char* source_path, const char* buf, size_t len, char delim) {
+    if (len >= LINE_INDEX_SIDECAR_MIN && line_index_load(index, source_path, delim) == 0) return 0;
+    if (line_index_build(index, buf, len, delim, 0) != 0) return -1;
+    // a sidecar that can't be written (read only directory, ...) just means rescanning next time
+    if (len >= LINE_INDEX_SIDECAR_MIN) line_index_save(index, source_path);
+    return 0;
+}
+
+const char* map_file(const char* filename, size_t* len) {
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return NULL;
+    }
+    *len = st.st_size;
+    if (*len == 0) {
+        close(fd);
+        return "";
+    }
+    char* buf = mmap(NULL, *len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (buf == MAP_FAILED) return NULL;
+    madvise(buf, *len, MADV_WILLNEED);
+    return buf;
+}
+
+void unmap_file(const char* buf, size_t len) {
+    if (len) munmap((void*) buf, len);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LINE_INDEX_MIN_CHUNK (1024 * 1024) // don't hand a thread less than this many bytes
+#define LINE_INDEX_SIDECAR_MIN (64 * 1024 * 1024) // smaller files are cheaper to rescan
+#define LINE_INDEX_SUFFIX ".lidx"
+
+// Start offset of every line in a buffer. Line i spans offsets[i] up to the delimiter
+// before offsets[i + 1] (or the end of the buffer for the last line).
+typedef struct line_index {
+    uint64_t* offsets;
+    size_t count;
+    char delim;
+    void* map;      // set when offsets point into a mapped sidecar file
+    size_t map_len;
+} LineIndex;
+
+// Header of a sidecar index file, followed by count 64-bit offsets. The index is only
+// used while the source file still has the recorded size and modification time.
+struct line_index_header {
+    char magic[4];
+    uint32_t version;
+    uint64_t source_size;
+    int64_t source_mtime_sec;
+    int64_t source_mtime_nsec;
+    uint64_t count;
+    uint64_t delim;
+};
+
+// Indexes the lines of buf[0..len) split on delim. The buffer is cut into one chunk per
+// thread, each thread records the line starts that follow the delimiters inside its chunk,
+// and the per-thread lists are concatenated in order. threads of 0 uses every online CPU.
+// Like split_on_delim, a trailing delimiter does not start an empty last line.
+// Returns -1 if an allocation or a thread fails.
+int line_index_build(LineIndex* index, const char* buf, size_t len, char delim, int threads);
+
+// Length of line i, not counting its delimiter.
+size_t line_index_line_len(const LineIndex* index, const char* buf, size_t len, size_t i);
+
+void line_index_free(LineIndex* index);
+
+// Writes index to source_path + LINE_INDEX_SUFFIX, stamped with the source file's size and
+// mtime. The file is written under a temporary name and renamed into place. Returns -1 on failure.
+int line_index_save(const LineIndex* index, const char* source_path);
+
+// Maps the sidecar of source_path, so line i is found in O(1) without scanning the source.
+// Returns -1 if there is no sidecar or it no longer matches the source file.
+int line_index_load(LineIndex* index, const char* source_path, char delim);
+
+// Loads the sidecar of source_path if it is valid, otherwise builds the index from
+// buf[0..len) and, for files of at least LINE_INDEX_SIDECAR_MIN bytes, saves a sidecar
+// for next time. Returns -1 if the index could not be built.
+int line_index_open(LineIndex* index, const char* source_path, const char* buf, size_t len, char delim);
+
+// Maps filename read only. Returns NULL on failure; an empty file maps to "" with len 0.
+const char* map_file(const char* filename, size_t* len);
+void unmap_file(const char* buf, size_t len);
@@ -1,35 +1,99 @@
 #include <stdlib.h>
 #include <stdio.h>
 
+#include <string.h>
+
 #include "lmc.h"
+#include "opcode_hash.h"
 #include "string_utils.h"
 
-const char* opcodes[] = {
-    "HLT", "ADD", "SUB", "STA", "LDA", "BRA", "BRZ", "BRP", "INP", "OUT", "DAT"
-};
+// Returns a pointer to the next whitespace separated token in str and stores its length
+// in len. A "//" comment ends the line. Returns NULL when no token is left.
+static char* next_token(char* str, size_t* len) {
+    while (*str == ' ' || *str == '\t' || *str == '\r') str++;
+    if (*str == '\0' || *str == '\n' || (str[0] == '/' && str[1] == '/')) {
+        return NULL;
+    }
+    size_t i = 0;
+    while (str[i] && str[i] != ' ' && str[i] != '\t' && str[i] != '\r' && str[i] != '\n') i++;
+    *len = i;
+    return str;
+}
+
+int opcode_lookup(const char* str, size_t len) {
+    if (len < OPCODE_MIN_LEN || len > OPCODE_MAX_LEN) return -1;
+    int pos = opcode_hash_table[opcode_hash(OPCODE_HASH_SEED, str, len) & (OPCODE_HASH_SIZE - 1)];
+    if (pos == -1 || strncmp(opcodes[pos], str, len) != 0 || opcodes[pos][len] != '\0') return -1;
+    return pos;
+}
 
-const int opcode_count = 11;
+int assembler_init(Assembler* as) {
+    as->label_addresses = NULL;
+    as->label_cap = 0;
+    return intern_init(&as->symbols, LMC_MEMORY_SIZE);
+}
 
-Instruction parse_input(char* str) {
+int assembler_define_labels(Assembler* as, char** lines, size_t count) {
+    for (size_t addr = 0; addr < count; addr++) {
+        size_t len = 0;
+        char* token = next_token(lines[addr], &len);
+        if (!token || opcode_lookup(token, len) != -1) continue;
+        int id = intern(&as->symbols, token, len);
+        if (id == -1) return -1;
+
+        if ((size_t) id >= as->label_cap) {
+            size_t cap = as->label_cap ? as->label_cap * 2 : LMC_MEMORY_SIZE;
+            while (cap <= (size_t) id) cap *= 2;
+            int* addresses = realloc(as->label_addresses, cap * sizeof(int));
+            if (!addresses) return -1;
+            for (size_t i = as->label_cap; i < cap; i++) addresses[i] = -1;
+            as->label_addresses = addresses;
+            as->label_cap = cap;
+        }
+        as->label_addresses[id] = addr;
+    }
+    return 0;
+}
+
+Instruction assemble_line(Assembler* as, char* line) {
     Instruction i = {
         .op = 0,
         .val = 0
     };
-    int pos = -1;
-    if ((pos = str_array_fuzzy_contains(opcodes, opcode_count, str)) != -1) {
-        size_t index = 0;
-        char** instr = split_on_delim(str, &index, ' ');
-        if (instr) {
-            i.op = pos;
-            i.val = atoi(instr[1]);
-        }
-        free(instr[0]);
-        free(instr[1]);
-        free (instr);
+    size_t len = 0;
+    char* token = next_token(line, &len);
+    int op = -1;
+    // a leading label is skipped, the mnemonic is the first or second token
+    for (int n = 0; token && n < 2; n++) {
+        if ((op = opcode_lookup(token, len)) != -1) break;
+        token = next_token(token + len, &len);
+    }
+    if (op == -1) return i;
+
+    i.op = op;
+    char* operand = next_token(token + len, &len);
+    if (!operand) return i;
+    if ((operand[0] >= '0' && operand[0] <= '9') || operand[0] == '-') {
+        i.val = atoi(operand);
+        return i;
+    }
+    int label = intern_lookup(&as->symbols, operand, len);
+    if (label != -1 && (size_t) label < as->label_cap && as->label_addresses[label] != -1) {
+        i.val = as->label_addresses[label];
+    }
+    else {
+        printf("\nundefined label %.*s", (int) len, operand);
     }
     return i;
 }
 
+void assembler_free(Assembler* as) {
+    intern_free(&as->symbols);
+    free(as->label_addresses);
+    as->label_addresses = NULL;
+    as->label_cap = 0;
+}
+
 void add(lmc_state* state, byte address) {
     byte address_bounded = address/*  % LMC_MEMORY_SIZE */;
     if (DEBUG) {
@@ -100,7 +164,3 @@ void hlt(lmc_state* state, byte address) {
 lmc_functions functions[] = {
     &hlt, &add, &sub, &sta, &lda, &bra, &brz, &brp, &inp, &out
 };
-
-Opcode opcode_from_string(char* str) {
-    return str_array_fuzzy_contains(opcodes, opcode_count, str);
-}
@@ -1,5 +1,8 @@
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
+
+#include "intern.h"
 
 #define LMC_MEMORY_SIZE 100
 #define DEBUG true
@@ -21,11 +24,29 @@ typedef enum op {
 extern const char* opcodes[];
 extern const int opcode_count;
 
+// Hash used for the generated opcode table (see gen_opcode_hash.c). Shared by the
+// generator and the parser so both always agree on the slot of each mnemonic.
+static inline unsigned int opcode_hash(unsigned int seed, const char* str, size_t len) {
+    unsigned int h = seed;
+    for (size_t i = 0; i < len; i++) {
+        h = (h * 31) ^ (unsigned char) str[i];
+    }
+    return h ^ (h >> 7);
+}
+
 typedef struct instruction {
     int val;
     Opcode op;
 } Instruction;
 
+// Two pass assembler for programs that use labels (see test.lma). Mnemonics are found with
+// opcode_lookup, so only labels go in the symbol table.
+typedef struct assembler {
+    InternTable symbols;
+    int* label_addresses; // by symbol id, -1 until the label is defined
+    size_t label_cap;
+} Assembler;
+
 typedef uint8_t byte;
 
 typedef void (*lmc_functions)(lmc_state*, byte);
@@ -42,6 +63,15 @@ void out(lmc_state* state, byte address);
 
 extern lmc_functions functions[];
 
-Opcode opcode_from_string(char* str);
-Instruction parse_input (char* str);
-int get_input();
\ No newline at end of file
+// Exact lookup of a mnemonic of length len. Returns -1 if str is not an opcode.
+int opcode_lookup(const char* str, size_t len);
+int get_input();
+
+// Returns -1 if the symbol table can't be allocated.
+int assembler_init(Assembler* as);
+// First pass: every line that starts with a label defines it as that line's address.
+// Returns -1 if memory runs out.
+int assembler_define_labels(Assembler* as, char** lines, size_t count);
+// Second pass: the opcode of line and its operand, which may be a number or a label.
+Instruction assemble_line(Assembler* as, char* line);
+void assembler_free(Assembler* as);
\ No newline at end of file
@@ -3,7 +3,10 @@
 #include <string.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <sys/stat.h>
 
+#include "arena.h"
+#include "line_index.h"
 #include "string_utils.h"
 #include "lmc.h"
 
@@ -23,17 +26,34 @@ int main (int argc, char* argv[]) {
 
         // ================================= Load assembly =================================
 
-        char* file = file_into_str(argv[1]);
-        if (!file) {
+        // only a regular file that knows its size can be mapped; pipes, procfs files and
+        // anything mmap refuses are read instead
+        struct stat st;
+        size_t file_len = 0;
+        const char* file = NULL;
+        if (stat(argv[1], &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+            file = map_file(argv[1], &file_len);
+        }
+        char* file_read = file ? NULL : file_into_str(argv[1]);
+        if (!file && !file_read) {
             return 1;
         }
 
+        // every line and the instruction array live in one arena, freed in one call at the end
+        Arena arena = arena_new((file ? file_len : strlen(file_read)) + ARENA_DEFAULT_BLOCK_SIZE);
         size_t count = 0;
-        char** file_lines = split_on_delim(file, &count, '\n');
-        
-        free(file);
+        char** file_lines;
+        if (file) {
+            file_lines = split_on_delim_parallel(&arena, file, file_len, &count, '\n');
+            unmap_file(file, file_len);
+        }
+        else {
+            file_lines = split_on_delim_arena(&arena, file_read, &count, '\n');
+            free(file_read);
+        }
 
         if (!file_lines) {
+            arena_free(&arena);
             return 1;
         }
 
@@ -46,9 +66,24 @@ int main (int argc, char* argv[]) {
             .is_neg = false
         };
 
-        Instruction* instructions = malloc(count * sizeof(Instruction));
+        if (count > LMC_MEMORY_SIZE) {
+            count = LMC_MEMORY_SIZE;
+        }
+        Instruction* instructions = arena_alloc(&arena, count * sizeof(Instruction));
 
         if (!instructions) {
+            arena_free(&arena);
+            return 1;
+        }
+
+        Assembler assembler;
+        if (assembler_init(&assembler) != 0) {
+            arena_free(&arena);
+            return 1;
+        }
+        if (assembler_define_labels(&assembler, file_lines, count) != 0) {
+            assembler_free(&assembler);
+            arena_free(&arena);
             return 1;
         }
 
@@ -56,13 +91,14 @@ int main (int argc, char* argv[]) {
 
         printf("\n========= LOADING =========");
         for (size_t x = 0; x < count; x++) {
-            instructions[x] = parse_input(file_lines[x]);
+            instructions[x] = assemble_line(&assembler, file_lines[x]);
             
             if (instructions[x].op == 10) state.mem[x] = instructions[x].val;
             else state.mem[x] = (instructions[x].op * 100) + instructions[x].val;
 
             printf("\nstored %i in address %i", state.mem[x], x);
         }
+        assembler_free(&assembler);
         printf("\n\n====== LOADED, BEGIN ======\n");
 
         // ================================= LMC execution  =================================
@@ -77,6 +113,7 @@ int main (int argc, char* argv[]) {
             }
             else {
                 printf("error: invalid opcode");
+                arena_free(&arena);
                 return 1;
             }
             if (/* inst != BRZ &&  */inst != BRP && inst != BRA) state.program_counter ++;
@@ -86,11 +123,7 @@ int main (int argc, char* argv[]) {
 
 
         // ===================================== CLEANUP =====================================
-        for (size_t x = 0; x < count; x++) {
-            free(file_lines[x]);
-        }
-        free(file_lines);
-        free(instructions);
+        arena_free(&arena);
     }
     return 0;
 }
@@ -0,0 +1,8 @@
+#include "lmc.h"
+
+// Kept apart from lmc.c so gen_opcode_hash can link against it before lmc.o exists.
+const char* opcodes[] = {
+    "HLT", "ADD", "SUB", "STA", "LDA", "BRA", "BRZ", "BRP", "INP", "OUT", "DAT"
+};
+
+const int opcode_count = 11;
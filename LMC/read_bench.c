@@ -0,0 +1,161 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "async_read.h"
+#include "line_index.h"
+
+/*
+   Compares the ways of getting a file into a parser. Each reader feeds the file to the same
+   consumer, which counts lines, once with the file evicted from the page cache (cold) and
+   once with it cached (warm). Prints CSV:
+
+       reader,cache,bytes,seconds,mb_per_s,lines
+
+   Usage: ./read_bench [file] (default: generate a BENCH_FILE_SIZE temporary file)
+*/
+
+#define BENCH_FILE_SIZE (512UL * 1024 * 1024)
+#define BENCH_REPS 3
+
+typedef size_t (*reader_fn)(const char* path);
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static size_t count_lines(const char* buf, size_t len) {
+    size_t lines = 0;
+    const char* end = buf + len;
+    while ((buf = memchr(buf, '\n', end - buf))) {
+        lines++;
+        buf++;
+    }
+    return lines;
+}
+
+static int count_chunk(const char* chunk, size_t len, uint64_t offset, void* ctx) {
+    (void) offset;
+    *(size_t*) ctx += count_lines(chunk, len);
+    return 0;
+}
+
+// kilo's old editor_open_file loop
+static size_t read_getline(const char* path) {
+    FILE* fp = fopen(path, "r");
+    if (!fp) return 0;
+    char* line = NULL;
+    size_t cap = 0, lines = 0;
+    while (getline(&line, &cap, fp) != -1) lines++;
+    free(line);
+    fclose(fp);
+    return lines;
+}
+
+static size_t read_fread(const char* path) {
+    FILE* fp = fopen(path, "r");
+    if (!fp) return 0;
+    char* buf = malloc(ASYNC_READ_CHUNK_SIZE);
+    size_t len, lines = 0;
+    while ((len = fread(buf, 1, ASYNC_READ_CHUNK_SIZE, fp)) > 0) lines += count_lines(buf, len);
+    free(buf);
+    fclose(fp);
+    return lines;
+}
+
+static size_t read_pread(const char* path) {
+    size_t lines = 0;
+    pread_file(path, 0, count_chunk, &lines);
+    return lines;
+}
+
+static size_t read_async(const char* path) {
+    size_t lines = 0;
+    async_read_file(path, 0, 0, count_chunk, &lines);
+    return lines;
+}
+
+static size_t read_mmap(const char* path) {
+    size_t len;
+    const char* buf = map_file(path, &len);
+    if (!buf) return 0;
+    size_t lines = count_lines(buf, len);
+    unmap_file(buf, len);
+    return lines;
+}
+
+static void drop_cache(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) return;
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+}
+
+static int make_file(char* path, size_t size) {
+    int fd = mkstemp(path);
+    if (fd == -1) return -1;
+    char* buf = malloc(ASYNC_READ_CHUNK_SIZE);
+    for (size_t i = 0; i < ASYNC_READ_CHUNK_SIZE; i++) buf[i] = (i % 64 == 63) ? '\n' : 'a' + i % 26;
+    for (size_t done = 0; done < size; done += ASYNC_READ_CHUNK_SIZE) {
+        if (write(fd, buf, ASYNC_READ_CHUNK_SIZE) != ASYNC_READ_CHUNK_SIZE) {
+            free(buf);
+            close(fd);
+            return -1;
+        }
+    }
+    free(buf);
+    close(fd);
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    char tmp_path[] = "/tmp/read_bench_XXXXXX";
+    const char* path = argc > 1 ? argv[1] : tmp_path;
+    if (argc <= 1 && make_file(tmp_path, BENCH_FILE_SIZE) != 0) {
+        fprintf(stderr, "could not create %s\n", tmp_path);
+        return 1;
+    }
+    struct stat st;
+    if (stat(path, &st) == -1) {
+        perror(path);
+        return 1;
+    }
+
+    struct { const char* name; reader_fn fn; } readers[] = {
+        { "getline", read_getline },
+        { "fread", read_fread },
+        { "pread", read_pread },
+        { async_read_uses_io_uring() ? "io_uring" : "io_uring(pread fallback)", read_async },
+        { "mmap", read_mmap },
+    };
+
+    printf("reader,cache,bytes,seconds,mb_per_s,lines\n");
+    for (size_t r = 0; r < sizeof(readers) / sizeof(readers[0]); r++) {
+        for (int warm = 0; warm < 2; warm++) {
+            double best = 0;
+            size_t lines = 0;
+            if (warm) readers[r].fn(path);
+            for (int rep = 0; rep < BENCH_REPS; rep++) {
+                if (!warm) drop_cache(path);
+                double t = now();
+                lines = readers[r].fn(path);
+                t = now() - t;
+                if (rep == 0 || t < best) best = t;
+            }
+            printf("%s,%s,%lld,%.4f,%.1f,%zu\n", readers[r].name, warm ? "warm" : "cold",
+                   (long long) st.st_size, best, st.st_size / best / 1e6, lines);
+            fflush(stdout);
+        }
+    }
+    if (argc <= 1) unlink(tmp_path);
+    return 0;
+}
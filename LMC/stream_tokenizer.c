@@ -0,0 +1,102 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "stream_tokenizer.h"
+
+int token_stream_init(TokenStream* stream, int fd, char delim, size_t buffer_size) {
+    stream->fd = fd;
+    stream->delim = delim;
+    stream->cap = buffer_size ? buffer_size : TOKEN_STREAM_BUFFER_SIZE;
+    stream->buf = malloc(stream->cap);
+    stream->start = 0;
+    stream->end = 0;
+    stream->eof = 0;
+    stream->in_partial = 0;
+    return stream->buf ? 0 : -1;
+}
+
+// Moves the unfinished token to the front of the buffer and reads more after it.
+// Returns the number of bytes read, 0 at end of input and -1 on error.
+static ssize_t token_stream_fill(TokenStream* stream) {
+    if (stream->start > 0) {
+        memmove(stream->buf, &stream->buf[stream->start], stream->end - stream->start);
+        stream->end -= stream->start;
+        stream->start = 0;
+    }
+    ssize_t ret;
+    do {
+        ret = read(stream->fd, &stream->buf[stream->end], stream->cap - stream->end);
+    } while (ret < 0 && errno == EINTR);
+    if (ret > 0) stream->end += ret;
+    else if (ret == 0) stream->eof = 1;
+    return ret;
+}
+
+int token_stream_next(TokenStream* stream, const char** token, size_t* len, int* partial) {
+    size_t scanned = stream->start; // bytes before this are known not to hold a delimiter
+    while (1) {
+        char* delim = memchr(&stream->buf[scanned], stream->delim, stream->end - scanned);
+        if (delim) {
+            *token = &stream->buf[stream->start];
+            *len = delim - *token;
+            *partial = 0;
+            stream->start = delim - stream->buf + 1;
+            stream->in_partial = 0;
+            return 1;
+        }
+        if (stream->eof) {
+            if (stream->start == stream->end) {
+                // end of input. A token cut into pieces still owes its final (empty) piece.
+                if (!stream->in_partial) return 0;
+                *token = &stream->buf[stream->start];
+                *len = 0;
+                *partial = 0;
+                stream->in_partial = 0;
+                return 1;
+            }
+            *token = &stream->buf[stream->start];
+            *len = stream->end - stream->start;
+            *partial = 0;
+            stream->start = stream->end;
+            stream->in_partial = 0;
+            return 1;
+        }
+        if (stream->start == 0 && stream->end == stream->cap) {
+            // the token fills the whole buffer: hand it out in pieces
+            *token = stream->buf;
+            *len = stream->end;
+            *partial = 1;
+            stream->start = stream->end;
+            stream->in_partial = 1;
+            return 1;
+        }
+        scanned = stream->end - stream->start;
+        if (token_stream_fill(stream) < 0) return -1;
+    }
+}
+
+void token_stream_free(TokenStream* stream) {
+    free(stream->buf);
+    stream->buf = NULL;
+}
+
+int stream_tokenize(int fd, char delim, size_t buffer_size,
+                    int (*callback)(const char* token, size_t len, int partial, void* ctx), void* ctx) {
+    TokenStream stream;
+    if (token_stream_init(&stream, fd, delim, buffer_size) != 0) return -1;
+    const char* token;
+    size_t len;
+    int partial;
+    int ret;
+    while ((ret = token_stream_next(&stream, &token, &len, &partial)) == 1) {
+        int cb_ret = callback(token, len, partial, ctx);
+        if (cb_ret != 0) {
+            ret = cb_ret;
+            break;
+        }
+    }
+    token_stream_free(&stream);
+    return ret;
+}
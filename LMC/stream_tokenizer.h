@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stddef.h>
+
+#define TOKEN_STREAM_BUFFER_SIZE (64 * 1024)
+
+// Splits whatever is read from a file descriptor into tokens using one fixed size buffer,
+// so memory use does not depend on how much input there is. Meant for pipes and other
+// streams that can't be loaded whole like split_on_delim needs.
+typedef struct token_stream {
+    int fd;
+    char delim;
+    char* buf;
+    size_t cap;
+    size_t start;   // first byte not handed out yet
+    size_t end;     // end of the data read so far
+    int eof;
+    int in_partial; // the last token returned was cut short and continues in the next one
+} TokenStream;
+
+// Returns -1 if the buffer can't be allocated. buffer_size of 0 selects TOKEN_STREAM_BUFFER_SIZE.
+int token_stream_init(TokenStream* stream, int fd, char delim, size_t buffer_size);
+
+// Stores the next token in *token and *len. The token points into the stream's buffer and
+// is only valid until the next call. A token longer than the buffer is returned in pieces:
+// *partial is set on every piece but the last. Like split_on_delim, a trailing delimiter
+// does not produce an empty last token.
+// Returns 1 for a token, 0 at the end of the stream and -1 on a read error.
+int token_stream_next(TokenStream* stream, const char** token, size_t* len, int* partial);
+
+void token_stream_free(TokenStream* stream);
+
+// Runs callback on every token of fd (see token_stream_next). Stops early and returns the
+// callback's value if it is non zero. Otherwise returns 0, or -1 on error.
+int stream_tokenize(int fd, char delim, size_t buffer_size,
+                    int (*callback)(const char* token, size_t len, int partial, void* ctx), void* ctx);
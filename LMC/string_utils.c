@@ -2,7 +2,12 @@
 #include <string.h>
 #include <stdio.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include "string_utils.h"
+#include "line_index.h"
+#include "async_read.h"
 
 
 String lazy_append_to_string(char* dest, const char* input) {
@@ -110,6 +115,52 @@ char** split_on_delim(char* str, size_t* index, const char DELIM) {
     return arr;
 }
 
+char** split_on_delim_arena(Arena* arena, const char* str, size_t* index, const char DELIM) {
+    size_t str_len = strlen(str);
+    size_t count = 0;
+    // count the tokens first so the array is allocated once. Like tokenize_string, a
+    // trailing delimiter does not produce an empty last token.
+    for (const char* p = str; (p = memchr(p, DELIM, str + str_len - p)); p++) {
+        count++;
+    }
+    if (str_len && str[str_len - 1] != DELIM) count++;
+
+    char** arr = arena_alloc(arena, (count ? count : 1) * sizeof(char*));
+    if (!arr) return NULL;
+
+    size_t start = 0;
+    while (start < str_len) {
+        const char* delim = memchr(&str[start], DELIM, str_len - start);
+        size_t end = delim ? (size_t) (delim - str) : str_len;
+        char* token = arena_strndup(arena, &str[start], end - start);
+        if (!token) return NULL;
+        arr[*index] = token;
+        *index += 1;
+        start = end + 1;
+    }
+    return arr;
+}
+
+char** split_on_delim_parallel(Arena* arena, const char* str, size_t len, size_t* index, const char DELIM) {
+    LineIndex lines;
+    if (line_index_build(&lines, str, len, DELIM, 0) != 0) return NULL;
+
+    char** arr = arena_alloc(arena, (lines.count ? lines.count : 1) * sizeof(char*));
+    if (arr) {
+        for (size_t i = 0; i < lines.count; i++) {
+            char* token = arena_strndup(arena, &str[lines.offsets[i]], line_index_line_len(&lines, str, len, i));
+            if (!token) {
+                arr = NULL;
+                break;
+            }
+            arr[*index] = token;
+            *index += 1;
+        }
+    }
+    line_index_free(&lines);
+    return arr;
+}
+
 int str_array_contains(const char* arr[], size_t arr_len, char* str) {
     for (size_t i = 0; i < arr_len; i++) {
         if (strcmp(arr[i], str) == 0) return i;
@@ -124,31 +175,66 @@ int str_array_fuzzy_contains(const char* arr[], size_t arr_len, char* str) {
     return -1;
 }
 
-char* file_into_str(const char* filename) {
-    FILE* file_ptr;
-    char* file_contents = strdup("");
-    String new_str;
+struct file_into_str_ctx {
+    char* buf;
+    size_t len;
+    size_t cap; // not counting the terminator
+};
 
-    file_ptr = fopen(filename, "r");
-    if(file_ptr == NULL) {
-        return NULL;
-    }
+// Makes room for need bytes, at least doubling. Returns -1 if realloc fails.
+static int reserve(struct file_into_str_ctx* dest, size_t need) {
+    if (need <= dest->cap) return 0;
+    size_t cap = dest->cap * 2 > need ? dest->cap * 2 : need;
+    char* buf = realloc(dest->buf, cap + 1);
+    if (!buf) return -1;
+    dest->buf = buf;
+    dest->cap = cap;
+    return 0;
+}
 
-    char buffer[READ_CHUNK_SIZE];
+static int copy_chunk(const char* chunk, size_t len, uint64_t offset, void* ctx) {
+    struct file_into_str_ctx* dest = ctx;
+    if (reserve(dest, offset + len) != 0) return -1;
+    memcpy(&dest->buf[offset], chunk, len);
+    if (offset + len > dest->len) dest->len = offset + len;
+    return 0;
+}
 
-    while (!feof(file_ptr)) {
-        fgets(buffer, READ_CHUNK_SIZE - 1, file_ptr);
-        new_str = lazy_append_to_string(file_contents, buffer);
-        if (new_str.ptr) {
-            file_contents = new_str.ptr;
-        }
-        else {
-            free(new_str.ptr);
-            free(file_contents);
-            file_contents = NULL;
+char* file_into_str(const char* filename) {
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return NULL;
+    }
+    // st_size is only a hint: procfs files say 0 and pipes have no size. A regular file's
+    // bytes up to it come through async_read_file, and whatever is past them, or the whole
+    // of anything else, is read until EOF.
+    struct file_into_str_ctx ctx = { 0 };
+    int ret = reserve(&ctx, st.st_size > 0 ? (size_t) st.st_size : FILE_READ_MIN_SIZE);
+    if (ret == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        ret = async_read_file(filename, 0, 0, copy_chunk, &ctx);
+        if (ret == 0 && lseek(fd, ctx.len, SEEK_SET) == -1) ret = -1;
+    }
+    while (ret == 0) {
+        if (ctx.len == ctx.cap && reserve(&ctx, ctx.cap + 1) != 0) {
+            ret = -1;
             break;
         }
+        ssize_t got = read(fd, &ctx.buf[ctx.len], ctx.cap - ctx.len);
+        if (got < 0 && errno == EINTR) continue;
+        if (got < 0) ret = -1;
+        if (got <= 0) break;
+        ctx.len += got;
+    }
+    close(fd);
+    if (ret != 0) {
+        free(ctx.buf);
+        return NULL;
     }
-    fclose(file_ptr);
-    return file_contents;
-}
\ No newline at end of file
+    ctx.buf[ctx.len] = '\0';
+    return ctx.buf;
+}
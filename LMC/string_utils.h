@@ -1,5 +1,9 @@
 #pragma once
 
+#include <stddef.h>
+
+#include "arena.h"
+
 struct StrInfo {
     size_t len;
     size_t old_len;
@@ -9,6 +13,7 @@ struct StrInfo {
 typedef struct StrInfo String;
 #undef READ_CHUNK_SIZE
 #define READ_CHUNK_SIZE 32
+#define FILE_READ_MIN_SIZE 4096 // first buffer for a file that doesn't say how big it is
 
 // Append a string to another without modifying either string. String.ptr will be NULL if realloc fails.
 String lazy_append_to_string(char* dest, const char* input);
@@ -22,6 +27,14 @@ char* read_string(char stop_char);
 // Returns NULL if malloc'ing or realloc'ing fails
 char** split_on_delim(char* str, size_t* index, const char DELIM);
 
+// Same as split_on_delim, but the array and every token are allocated from arena, so the
+// whole split is released by a single arena_free. Returns NULL if the arena runs out of memory.
+char** split_on_delim_arena(Arena* arena, const char* str, size_t* index, const char DELIM);
+
+// Same as split_on_delim_arena for a buffer of known length, but the lines are found by
+// line_index_build on all CPUs first. Meant for large and memory mapped inputs.
+char** split_on_delim_parallel(Arena* arena, const char* str, size_t len, size_t* index, const char DELIM);
+
 // Returns NULL if realloc'ing fails.
 char* tokenize_string(char* str, char DELIM, size_t* index);
 
@@ -32,5 +45,6 @@ int str_array_contains(const char* arr[], size_t arr_len, char* str);
 // a superset of the given string.
 int str_array_fuzzy_contains(const char* arr[], size_t arr_len, char* str);
 
-// Returns NULL on read failure.
+// Reads the whole file, through async_read_file as far as its size says and then until
+// EOF, so pipes and procfs files work too. Returns NULL on read failure.
 char* file_into_str(const char* filename);
\ No newline at end of file
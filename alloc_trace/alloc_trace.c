@@ -0,0 +1,229 @@
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <malloc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc_trace.h"
+
+#define TRACE_MAX_SITES 4096 // call sites past this are counted under one overflow entry
+#define TRACE_CALLER() __builtin_extract_return_addr(__builtin_return_address(0))
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void *__libc_valloc(size_t size);
+extern void *__libc_pvalloc(size_t size);
+
+enum trace_kind { TRACE_MALLOC, TRACE_CALLOC, TRACE_REALLOC, TRACE_FREE, TRACE_KINDS };
+
+struct trace_site {
+    void *caller;
+    size_t calls[TRACE_KINDS];
+    size_t bytes;           // bytes requested by malloc, calloc and realloc
+    size_t realloc_growth;  // bytes a block grew by across reallocs
+    size_t realloc_moves;   // reallocs that had to move the block
+};
+
+// Everything below is touched from inside malloc, so it lives in static storage and is
+// guarded by a spin lock rather than anything that could allocate.
+static struct trace_site sites[TRACE_MAX_SITES + 1];
+static size_t site_count = 0;
+static size_t live_bytes = 0;
+static size_t peak_live_bytes = 0;
+static char lock = 0;
+
+static void trace_lock() {
+    while (__atomic_test_and_set(&lock, __ATOMIC_ACQUIRE))
+        ;
+}
+
+static void trace_unlock() {
+    __atomic_clear(&lock, __ATOMIC_RELEASE);
+}
+
+static struct trace_site *trace_site_for(void *caller) {
+    size_t slot = ((uintptr_t) caller >> 2) % TRACE_MAX_SITES;
+    for (size_t probe = 0; probe < TRACE_MAX_SITES; probe++) {
+        struct trace_site *site = &sites[(slot + probe) % TRACE_MAX_SITES];
+        if (site->caller == caller)
+            return site;
+        if (site->caller == NULL) {
+            site->caller = caller;
+            site_count++;
+            return site;
+        }
+    }
+    return &sites[TRACE_MAX_SITES];
+}
+
+static void trace_record(void *caller, enum trace_kind kind, size_t bytes, size_t old_usable, void *old_ptr, void *ptr) {
+    trace_lock();
+    struct trace_site *site = trace_site_for(caller);
+    site->calls[kind]++;
+    site->bytes += bytes;
+    if (kind == TRACE_FREE) {
+        live_bytes -= old_usable;
+    }
+    else if (ptr) {
+        size_t usable = malloc_usable_size(ptr);
+        live_bytes += usable - old_usable;
+        if (kind == TRACE_REALLOC && old_ptr) {
+            if (usable > old_usable) site->realloc_growth += usable - old_usable;
+            if (ptr != old_ptr) site->realloc_moves++;
+        }
+    }
+    else if (kind == TRACE_REALLOC && bytes == 0) {
+        live_bytes -= old_usable; // realloc(ptr, 0) frees
+    }
+    if (live_bytes > peak_live_bytes)
+        peak_live_bytes = live_bytes;
+    trace_unlock();
+}
+
+void *malloc(size_t size) {
+    void *ptr = __libc_malloc(size);
+    trace_record(TRACE_CALLER(), TRACE_MALLOC, size, 0, NULL, ptr);
+    return ptr;
+}
+
+void *calloc(size_t n, size_t size) {
+    void *ptr = __libc_calloc(n, size);
+    trace_record(TRACE_CALLER(), TRACE_CALLOC, n * size, 0, NULL, ptr);
+    return ptr;
+}
+
+void *realloc(void *old_ptr, size_t size) {
+    size_t old_usable = old_ptr ? malloc_usable_size(old_ptr) : 0;
+    void *ptr = __libc_realloc(old_ptr, size);
+    trace_record(TRACE_CALLER(), TRACE_REALLOC, size, old_usable, old_ptr, ptr);
+    return ptr;
+}
+
+// The aligned allocators count as mallocs. glibc wants them replaced along with malloc, and
+// their blocks would otherwise reach free without having been added to live_bytes.
+void *memalign(size_t alignment, size_t size) {
+    void *ptr = __libc_memalign(alignment, size);
+    trace_record(TRACE_CALLER(), TRACE_MALLOC, size, 0, NULL, ptr);
+    return ptr;
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+    void *ptr = __libc_memalign(alignment, size);
+    trace_record(TRACE_CALLER(), TRACE_MALLOC, size, 0, NULL, ptr);
+    return ptr;
+}
+
+int posix_memalign(void **out, size_t alignment, size_t size) {
+    if (alignment == 0 || alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0)
+        return EINVAL;
+    void *ptr = __libc_memalign(alignment, size);
+    trace_record(TRACE_CALLER(), TRACE_MALLOC, size, 0, NULL, ptr);
+    if (ptr == NULL)
+        return ENOMEM;
+    *out = ptr;
+    return 0;
+}
+
+void *valloc(size_t size) {
+    void *ptr = __libc_valloc(size);
+    trace_record(TRACE_CALLER(), TRACE_MALLOC, size, 0, NULL, ptr);
+    return ptr;
+}
+
+void *pvalloc(size_t size) {
+    void *ptr = __libc_pvalloc(size);
+    trace_record(TRACE_CALLER(), TRACE_MALLOC, size, 0, NULL, ptr);
+    return ptr;
+}
+
+void free(void *ptr) {
+    if (ptr == NULL)
+        return;
+    size_t usable = malloc_usable_size(ptr);
+    __libc_free(ptr);
+    trace_record(TRACE_CALLER(), TRACE_FREE, 0, usable, ptr, NULL);
+}
+
+static size_t site_allocs(const struct trace_site *site) {
+    return site->calls[TRACE_MALLOC] + site->calls[TRACE_CALLOC] + site->calls[TRACE_REALLOC];
+}
+
+static int compare_sites(const void *a, const void *b) {
+    size_t x = site_allocs(a), y = site_allocs(b);
+    return (x < y) - (x > y);
+}
+
+void alloc_trace_report(FILE *out) {
+    static struct trace_site snapshot[TRACE_MAX_SITES + 1];
+    size_t count = 0;
+    size_t live, peak;
+
+    // copy under the lock, symbolize without it: dladdr and stdio may allocate
+    trace_lock();
+    for (size_t i = 0; i <= TRACE_MAX_SITES; i++) {
+        if (sites[i].caller || site_allocs(&sites[i]) || sites[i].calls[TRACE_FREE])
+            snapshot[count++] = sites[i];
+    }
+    live = live_bytes;
+    peak = peak_live_bytes;
+    trace_unlock();
+
+    qsort(snapshot, count, sizeof(struct trace_site), compare_sites);
+
+    size_t totals[TRACE_KINDS] = {0};
+    size_t total_bytes = 0, total_growth = 0, total_moves = 0;
+    for (size_t i = 0; i < count; i++) {
+        for (int k = 0; k < TRACE_KINDS; k++) totals[k] += snapshot[i].calls[k];
+        total_bytes += snapshot[i].bytes;
+        total_growth += snapshot[i].realloc_growth;
+        total_moves += snapshot[i].realloc_moves;
+    }
+
+    fprintf(out, "\n==== alloc_trace: %zu malloc, %zu calloc, %zu realloc, %zu free ====\n",
+            totals[TRACE_MALLOC], totals[TRACE_CALLOC], totals[TRACE_REALLOC], totals[TRACE_FREE]);
+    fprintf(out, "requested %zu bytes, realloc growth %zu bytes in %zu moves, peak live %zu bytes, live at exit %zu bytes\n",
+            total_bytes, total_growth, total_moves, peak, live);
+    fprintf(out, "%10s %10s %10s %10s %14s %14s %10s  %s\n",
+            "malloc", "calloc", "realloc", "free", "bytes", "re_growth", "re_moves", "call site");
+    for (size_t i = 0; i < count; i++) {
+        struct trace_site *site = &snapshot[i];
+        char where[256] = "(other call sites)";
+        Dl_info info;
+        if (site->caller && dladdr(site->caller, &info) && info.dli_fname) {
+            const char *module = strrchr(info.dli_fname, '/');
+            module = module ? module + 1 : info.dli_fname;
+            // module+offset can be fed to addr2line -e <module> when the symbol is static
+            if (info.dli_sname)
+                snprintf(where, sizeof(where), "%s+0x%lx (%s+0x%lx)", module,
+                         (unsigned long) ((char *) site->caller - (char *) info.dli_fbase), info.dli_sname,
+                         (unsigned long) ((char *) site->caller - (char *) info.dli_saddr));
+            else
+                snprintf(where, sizeof(where), "%s+0x%lx", module,
+                         (unsigned long) ((char *) site->caller - (char *) info.dli_fbase));
+        }
+        else if (site->caller) {
+            snprintf(where, sizeof(where), "%p", site->caller);
+        }
+        fprintf(out, "%10zu %10zu %10zu %10zu %14zu %14zu %10zu  %s\n",
+                site->calls[TRACE_MALLOC], site->calls[TRACE_CALLOC], site->calls[TRACE_REALLOC],
+                site->calls[TRACE_FREE], site->bytes, site->realloc_growth, site->realloc_moves, where);
+    }
+}
+
+static void alloc_trace_at_exit() {
+    const char *path = getenv("ALLOC_TRACE_OUT");
+    FILE *out = path ? fopen(path, "w") : NULL;
+    alloc_trace_report(out ? out : stderr);
+    if (out)
+        fclose(out);
+}
+
+__attribute__((constructor)) static void alloc_trace_init() {
+    atexit(alloc_trace_at_exit);
+}
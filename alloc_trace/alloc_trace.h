@@ -0,0 +1,23 @@
+#ifndef __ALLOC_TRACE_H
+#define __ALLOC_TRACE_H
+
+#include <stdio.h>
+
+/*
+   Opt-in allocation telemetry. Building any subproject with `make TRACE_ALLOC=1` links
+   alloc_trace.o, which replaces malloc, calloc, realloc and free for the whole program
+   (glibc allows this), and the aligned allocators, which are counted as mallocs. Every
+   call is counted against its call site, the return address of the allocator call, and a
+   report is printed when the program exits.
+
+   The report goes to stderr, or to the file named by ALLOC_TRACE_OUT if it is set
+   (useful for kilo, which owns the terminal).
+
+   Allocations made inside libc, e.g. by strdup or getline, are reported under the libc
+   function that made them.
+*/
+
+// Prints the report so far. Called automatically at exit.
+void alloc_trace_report(FILE *out);
+
+#endif
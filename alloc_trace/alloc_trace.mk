@@ -0,0 +1,10 @@
+# Included by every subproject Makefile. `make TRACE_ALLOC=1` links alloc_trace.o into the
+# target; -rdynamic exports the program's own symbols so call sites can be named.
+# alloc_trace.o only replaces the allocator at link time, so nothing else needs rebuilding,
+# but run `make clean` (or touch a source) when switching so the target is relinked.
+ALLOC_TRACE_DIR := $(dir $(lastword $(MAKEFILE_LIST)))
+
+ifdef TRACE_ALLOC
+ALLOC_TRACE_OBJ = $(ALLOC_TRACE_DIR)alloc_trace.o
+CFLAGS += -rdynamic
+endif
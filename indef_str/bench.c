@@ -0,0 +1,98 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "indefinite_string.h"
+
+/*
+   Builds one big string out of small pieces, first with append_to_string and then with the
+   rope, and prints CSV:
+
+       method,bytes,piece_len,seconds,mb_per_s,chunks
+
+   append_to_string is quadratic, so its sizes stop once a run goes over the time budget.
+   The rope also gets timed for rope_flatten and for rope_writev to /dev/null.
+
+   Usage: ./rope_bench [max_bytes] [piece_len] [budget_seconds]
+*/
+
+#define BENCH_MIN_SIZE (1024UL * 1024)
+#define BENCH_MAX_SIZE (1024UL * 1024 * 1024)
+#define BENCH_SIZE_STEP 4
+#define BENCH_PIECE_LEN 32
+#define BENCH_BUDGET 2.0
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char* method, size_t size, size_t piece_len, double t, size_t chunks) {
+    printf("%s,%zu,%zu,%.4f,%.1f,%zu\n", method, size, piece_len, t, size / t / 1e6, chunks);
+    fflush(stdout);
+}
+
+int main(int argc, char* argv[]) {
+    size_t max_size = argc > 1 ? strtoull(argv[1], NULL, 10) : BENCH_MAX_SIZE;
+    size_t piece_len = argc > 2 ? strtoull(argv[2], NULL, 10) : BENCH_PIECE_LEN;
+    double budget = argc > 3 ? atof(argv[3]) : BENCH_BUDGET;
+    if (piece_len == 0) piece_len = BENCH_PIECE_LEN;
+
+    char* piece = malloc(piece_len + 1);
+    for (size_t i = 0; i < piece_len; i++) piece[i] = (i == piece_len - 1) ? '\n' : 'a' + i % 26;
+    piece[piece_len] = '\0';
+
+    printf("method,bytes,piece_len,seconds,mb_per_s,chunks\n");
+    int append_over_budget = 0;
+    for (size_t size = BENCH_MIN_SIZE; size <= max_size; size *= BENCH_SIZE_STEP) {
+        if (!append_over_budget) {
+            char* str = new_string("");
+            double t = now();
+            for (size_t done = 0; str && done < size; done += piece_len) {
+                str = append_to_string(str, piece);
+            }
+            t = now() - t;
+            free(str);
+            report("append_to_string", size, piece_len, t, 1);
+            if (t * BENCH_SIZE_STEP * BENCH_SIZE_STEP > budget) {
+                append_over_budget = 1;
+                fprintf(stderr, "append_to_string: skipping sizes from %zu, over the %.1fs budget\n",
+                        size * BENCH_SIZE_STEP, budget);
+            }
+        }
+
+        Rope* rope = rope_new();
+        double t = now();
+        for (size_t done = 0; rope && done < size; done += piece_len) {
+            if (rope_append(rope, piece, piece_len) != 0) {
+                fprintf(stderr, "out of memory at %zu bytes\n", done);
+                return 1;
+            }
+        }
+        t = now() - t;
+        report("rope_append", size, piece_len, t, rope->chunk_count);
+
+        int fd = open("/dev/null", O_WRONLY);
+        t = now();
+        ssize_t written = rope_writev(rope, fd);
+        t = now() - t;
+        close(fd);
+        if (written != (ssize_t) rope->len) fprintf(stderr, "rope_writev wrote %zd of %zu bytes\n", written, rope->len);
+        report("rope_writev", size, piece_len, t, rope->chunk_count);
+
+        size_t chunks = rope->chunk_count;
+        t = now();
+        const char* flat = rope_flatten(rope);
+        t = now() - t;
+        if (!flat || strlen(flat) != rope->len) fprintf(stderr, "rope_flatten gave the wrong string\n");
+        report("rope_flatten", size, piece_len, t, chunks);
+        rope_free(rope);
+    }
+    free(piece);
+    return 0;
+}
@@ -1,7 +1,11 @@
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <sys/uio.h>
 #include "indefinite_string.h"
 
+#define ROPE_IOV_BATCH 1024 // chunks handed to one writev call, IOV_MAX on Linux
+
 int round_up(int number, int base) {
     return number + (base - (number % base));
 }
@@ -34,3 +38,133 @@ char* append_to_string(char* dest, const char* input) {
     }
     return realloc_ret;
 }
+
+Rope* rope_new() {
+    Rope* rope = calloc(1, sizeof(Rope));
+    return rope;
+}
+
+static RopeChunk* rope_new_chunk(size_t cap) {
+    RopeChunk* chunk = malloc(sizeof(RopeChunk) + cap);
+    if (chunk != NULL) {
+        chunk->next = NULL;
+        chunk->len = 0;
+        chunk->cap = cap;
+    }
+    return chunk;
+}
+
+int rope_append(Rope* rope, const char* input, size_t len) {
+    if (len == 0) {
+        return 0;
+    }
+    RopeChunk* tail = rope->tail;
+    size_t room = tail ? tail->cap - tail->len : 0;
+    if (len > room) {
+        // fill what's left of the tail, then start one chunk big enough for the rest. Chunks
+        // grow with the string, so the chunk count stays small until ROPE_MAX_CHUNK.
+        size_t rest = len - room;
+        size_t cap = rope->len < ROPE_MIN_CHUNK ? ROPE_MIN_CHUNK : rope->len;
+        if (cap > ROPE_MAX_CHUNK) cap = ROPE_MAX_CHUNK;
+        if (cap < rest) cap = rest;
+        RopeChunk* chunk = rope_new_chunk(cap);
+        if (chunk == NULL) {
+            return -1;
+        }
+        if (room) {
+            memcpy(&tail->data[tail->len], input, room);
+            tail->len += room;
+        }
+        memcpy(chunk->data, input + room, rest);
+        chunk->len = rest;
+        if (tail) tail->next = chunk;
+        else rope->head = chunk;
+        rope->tail = chunk;
+        rope->chunk_count++;
+    }
+    else {
+        memcpy(&tail->data[tail->len], input, len);
+        tail->len += len;
+    }
+    rope->len += len;
+    return 0;
+}
+
+const char* rope_flatten(Rope* rope) {
+    RopeChunk* head = rope->head;
+    if (head && head == rope->tail && head->len < head->cap) {
+        head->data[head->len] = '\0';
+        return head->data;
+    }
+    RopeChunk* flat = rope_new_chunk(rope->len + 1);
+    if (flat == NULL) {
+        return NULL;
+    }
+    RopeChunk* chunk = head;
+    while (chunk) {
+        RopeChunk* next = chunk->next;
+        memcpy(&flat->data[flat->len], chunk->data, chunk->len);
+        flat->len += chunk->len;
+        free(chunk);
+        chunk = next;
+    }
+    flat->data[flat->len] = '\0';
+    rope->head = flat;
+    rope->tail = flat;
+    rope->chunk_count = 1;
+    return flat->data;
+}
+
+int rope_for_each_chunk(Rope* rope, int (*callback)(const char* chunk, size_t len, void* ctx), void* ctx) {
+    for (RopeChunk* chunk = rope->head; chunk; chunk = chunk->next) {
+        int ret = callback(chunk->data, chunk->len, ctx);
+        if (ret != 0) {
+            return ret;
+        }
+    }
+    return 0;
+}
+
+ssize_t rope_writev(Rope* rope, int fd) {
+    struct iovec iov[ROPE_IOV_BATCH];
+    RopeChunk* chunk = rope->head;
+    size_t skip = 0; // bytes of chunk already written by a short writev
+    size_t total = 0;
+    while (chunk) {
+        int count = 0;
+        for (RopeChunk* c = chunk; c && count < ROPE_IOV_BATCH; c = c->next) {
+            iov[count].iov_base = c->data + (c == chunk ? skip : 0);
+            iov[count].iov_len = c->len - (c == chunk ? skip : 0);
+            count++;
+        }
+        ssize_t ret = writev(fd, iov, count);
+        if (ret <= 0) {
+            if (ret < 0 && errno == EINTR) continue;
+            // every chunk holds at least a byte, so writing none would never finish
+            return -1;
+        }
+        total += ret;
+        // step over everything that made it out
+        size_t done = ret;
+        while (chunk && done >= chunk->len - skip) {
+            done -= chunk->len - skip;
+            skip = 0;
+            chunk = chunk->next;
+        }
+        skip += done;
+    }
+    return total;
+}
+
+void rope_free(Rope* rope) {
+    if (rope == NULL) {
+        return;
+    }
+    RopeChunk* chunk = rope->head;
+    while (chunk) {
+        RopeChunk* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    free(rope);
+}
@@ -1,5 +1,47 @@
+#include <stddef.h>
+#include <sys/types.h>
+
 #define STRING_CHUNK_SIZE 32
+#define ROPE_MIN_CHUNK 4096
+#define ROPE_MAX_CHUNK (1024 * 1024)
 
 char* new_string(const char* input);
 char* append_to_string(char* dest, const char* input);
 int round_up(int number, int base);
+
+// A string kept as a list of chunks, for building very large strings out of small pieces.
+// Appending copies each byte once instead of reallocating the whole string every time.
+typedef struct rope_chunk {
+    struct rope_chunk* next;
+    size_t len;
+    size_t cap;
+    char data[];
+} RopeChunk;
+
+typedef struct rope {
+    RopeChunk* head;
+    RopeChunk* tail;
+    size_t len;
+    size_t chunk_count;
+} Rope;
+
+// Returns NULL if malloc fails.
+Rope* rope_new();
+
+// Appends len bytes of input. Returns -1 if malloc fails, leaving the rope unchanged.
+int rope_append(Rope* rope, const char* input, size_t len);
+
+// Returns the whole string as one null terminated buffer, merging the chunks into one if
+// there is more than one. The pointer is owned by the rope and only valid until the next
+// append. Returns NULL if malloc fails.
+const char* rope_flatten(Rope* rope);
+
+// Calls callback on every chunk in order, without flattening. Stops early and returns the
+// callback's value if it is non zero.
+int rope_for_each_chunk(Rope* rope, int (*callback)(const char* chunk, size_t len, void* ctx), void* ctx);
+
+// Writes the whole string to fd with writev, straight from the chunks.
+// Returns the number of bytes written, or -1 on error or if writev writes nothing.
+ssize_t rope_writev(Rope* rope, int fd);
+
+void rope_free(Rope* rope);
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <string.h>
 #include "indefinite_string.h"
 
 #define STRING_CHUNK_SIZE 32
@@ -15,5 +16,13 @@ int main() {
         return 1;
     }
     printf("%s", str);
+
+    Rope* rope = rope_new();
+    if (rope == NULL || rope_append(rope, "", 0) != 0 || rope_append(rope, str, strlen(str)) != 0) {
+        printf("Append to rope failed.");
+        return 1;
+    }
+    printf("%s", rope_flatten(rope));
+    rope_free(rope);
     return 0;
 }
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include "editor.h"
 #include "termutils.h"
 
@@ -13,19 +14,40 @@ char *C_HL_keywords[] = {
     "void|", NULL};
 
 struct editor_syntax HLDB[] = {
-    {"c",
-     C_HL_extensions,
-     C_HL_keywords,
-     "//", "/*", "*/",
-     HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS}};
+    {.filetype = "c",
+     .filematch = C_HL_extensions,
+     .keywords = C_HL_keywords,
+     .singleline_comment_start = "//",
+     .multiline_comment_start = "/*",
+     .multiline_comment_end = "*/",
+     .flags = HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS}};
 
 void init_editor(struct editor_state *state) {
     if (state->filename) {
         free(state->filename);
     }
     if (state->row) {
+        for (size_t i = 0; i < state->n_rows; i++) {
+            if (state->row[i])
+                editor_free_row(state->row[i]);
+        }
         free(state->row);
     }
+    free(state->load_ring);
+    state->load_ring = NULL;
+    free(state->hl_state);
+    state->hl_state = NULL;
+    state->hl_frontier = 0;
+    state->lazy_rows = 0;
+    piece_table_free(&state->doc);
+    line_index_free(&state->lines);
+    screen_free(&state->screen);
+    search_free(&state->search);
+    undo_free(&state->undo);
+    if (state->map) {
+        unmap_file(state->map, state->map_len);
+        state->map = NULL;
+    }
     state->cx = 0;
     state->cy = 0;
     state->n_rows = 0;
@@ -40,6 +62,170 @@ void init_editor(struct editor_state *state) {
     state->syntax = NULL;
     if (get_window_size(state) == -1) die("get_window_size", state);
     state->rows -= STATUSLINE_COUNT;
+    if (piece_table_init(&state->doc, NULL, 0, NULL, 0) != 0) die("piece_table_init", state);
+    // the lexer tables are built once, up front, so opening a file never pays for it
+    for (unsigned int j = 0; j < HLDB_ENTRIES; j++) {
+        if (editor_syntax_compile(&HLDB[j]) != 0) die("editor_syntax_compile", state);
+    }
+}
+
+// Keep state->doc in step with the rows. The document is every row followed by a '\n', so
+// (row, col) is col bytes past the start of line row. Every edit goes in the undo log too.
+static void editor_doc_insert(struct editor_state *state, size_t row, size_t col, const char *s, size_t len) {
+    size_t pos = piece_table_line_offset(&state->doc, row) + col;
+    if (undo_record(&state->undo, UNDO_INSERT, pos, s, len) != 0)
+        die("undo_record", state);
+    if (piece_table_insert(&state->doc, pos, s, len) != 0)
+        die("piece_table_insert", state);
+}
+
+static void editor_doc_delete(struct editor_state *state, size_t row, size_t col, size_t len) {
+    size_t pos = piece_table_line_offset(&state->doc, row) + col;
+    char small[64];
+    char *text = len <= sizeof(small) ? small : malloc(len);
+    if (text == NULL)
+        die("editor_doc_delete", state);
+    piece_table_read(&state->doc, pos, len, text);
+    if (undo_record(&state->undo, UNDO_DELETE, pos, text, len) != 0)
+        die("undo_record", state);
+    if (text != small)
+        free(text);
+    if (piece_table_delete(&state->doc, pos, len) != 0)
+        die("piece_table_delete", state);
+}
+
+// Makes an edit to the document and then to the rows, for undo, redo and pastes: the rows
+// it touches are dropped to be loaded again from the document, and the rest move up or down.
+static int editor_apply_edit(void *arg, enum undo_type type, size_t pos, const char *text, size_t len) {
+    struct editor_state *state = arg;
+    size_t first = piece_table_line_at(&state->doc, pos);
+    size_t removed = 0, added = 0;
+    if (type == UNDO_INSERT) {
+        for (const char *p = text; (p = memchr(p, '\n', text + len - p)) != NULL; p++)
+            added++;
+        if (piece_table_insert(&state->doc, pos, text, len) != 0)
+            return -1;
+    }
+    else {
+        removed = piece_table_line_at(&state->doc, pos + len) - first;
+        if (piece_table_delete(&state->doc, pos, len) != 0)
+            return -1;
+    }
+    size_t n_rows = state->n_rows + added - removed;
+    if (added > removed) {
+        e_row **rows = realloc(state->row, sizeof(e_row *) * n_rows);
+        if (rows == NULL)
+            return -1;
+        state->row = rows;
+        unsigned char *hl_state = realloc(state->hl_state, n_rows);
+        if (hl_state == NULL)
+            return -1;
+        state->hl_state = hl_state;
+    }
+    // lines first to first + removed were first to first + added, the line after the edit
+    // included unless it is past the end
+    size_t old_end = first + removed + 1 < state->n_rows ? first + removed + 1 : state->n_rows;
+    size_t new_end = first + added + 1 < n_rows ? first + added + 1 : n_rows;
+    for (size_t i = first; i < old_end; i++) {
+        if (state->row[i])
+            editor_free_row(state->row[i]);
+    }
+    memmove(&state->row[new_end], &state->row[old_end], sizeof(e_row *) * (state->n_rows - old_end));
+    memmove(&state->hl_state[new_end], &state->hl_state[old_end], state->n_rows - old_end);
+    for (size_t i = first; i < new_end; i++) {
+        state->row[i] = NULL;
+        state->hl_state[i] = 0;
+    }
+    state->n_rows = n_rows;
+    if (first < state->hl_frontier)
+        state->hl_frontier = first;
+    state->dirty++;
+    return 0;
+}
+
+// Ctrl-Z and Ctrl-Y: takes back or does again what one key did, and puts the cursor where
+// it was around that key.
+static void editor_undo(struct editor_state *state, int redo) {
+    size_t x, y;
+    int r = redo ? undo_redo(&state->undo, editor_apply_edit, state, &x, &y)
+                 : undo_undo(&state->undo, editor_apply_edit, state, &x, &y);
+    if (r < 0)
+        die(redo ? "undo_redo" : "undo_undo", state);
+    if (r == 0) {
+        editor_set_status(state, redo ? "Nothing to redo." : "Nothing to undo.");
+        return;
+    }
+    state->cy = y < state->n_rows ? y : state->n_rows;
+    state->cx = x;
+}
+
+// Lazy rows: once the ring has gone round, the row loaded longest ago is freed unless it is
+// on screen or next to the cursor. Any row can be loaded again from the document. Row numbers
+// in the ring go stale as rows are inserted and deleted, which only means some other row
+// gets evicted instead.
+static void editor_track_loaded_row(struct editor_state *state, size_t at) {
+    size_t *slot = &state->load_ring[state->load_ring_pos];
+    size_t old = *slot;
+    if (old < state->n_rows && state->row[old] && old != at &&
+        (old < state->row_offset || old >= state->row_offset + state->rows) &&
+        (old + 1 < state->cy || old > state->cy + 1)) {
+        editor_free_row(state->row[old]);
+        state->row[old] = NULL;
+    }
+    *slot = at;
+    state->load_ring_pos = (state->load_ring_pos + 1) % LAZY_ROW_CACHE;
+}
+
+// Builds row at from its line in the document.
+static e_row *editor_load_row(struct editor_state *state, size_t at) {
+    size_t start = piece_table_line_offset(&state->doc, at);
+    size_t len = piece_table_line_offset(&state->doc, at + 1) - start;
+    e_row *row = calloc(1, sizeof(e_row));
+    char *chars = malloc(len + 1);
+    if (row == NULL || chars == NULL)
+        die("editor_load_row", state);
+    piece_table_read(&state->doc, start, len, chars);
+    while (len > 0 && (chars[len - 1] == '\n' || chars[len - 1] == '\r'))
+        len--;
+    chars[len] = '\0';
+    row->chars = chars;
+    row->size = len;
+    if (row_index_build(&row->index, chars, len) != 0)
+        die("row_index_build", state);
+    state->row[at] = row; // the text is what the line's hl_state was worked out from
+    if (state->lazy_rows)
+        editor_track_loaded_row(state, at);
+    return row;
+}
+
+e_row *editor_row(struct editor_state *state, size_t at) {
+    e_row *row = state->row[at];
+    return row ? row : editor_load_row(state, at);
+}
+
+// Maps filename and starts the document over it, in place of the one there was. The
+// mapping stays for as long as the file is open, as the document's original text. Returns
+// the file's length.
+static size_t editor_map_file(struct editor_state *state, const char *filename) {
+    size_t len;
+    const char *buf = map_file(filename, &len);
+    if (!buf)
+        die("map_file", state);
+    LineIndex lines;
+    if (line_index_open(&lines, filename, buf, len, '\n') != 0)
+        die("line_index_open", state);
+    piece_table_free(&state->doc);
+    line_index_free(&state->lines);
+    if (state->map)
+        unmap_file(state->map, state->map_len);
+    state->map = buf;
+    state->map_len = len;
+    state->lines = lines;
+    if (piece_table_init(&state->doc, buf, len, lines.offsets, lines.count) != 0)
+        die("piece_table_init", state);
+    if (len && buf[len - 1] != '\n' && piece_table_insert(&state->doc, len, "\n", 1) != 0)
+        die("piece_table_insert", state);
+    return len;
 }
 
 void editor_open_file(struct editor_state *state, const char *filename) {
@@ -47,23 +233,181 @@ void editor_open_file(struct editor_state *state, const char *filename) {
     state->filename = strdup(filename);
     editor_select_highlight(state);
 
-    FILE *fp = fopen(filename, "r");
-    if (!fp)
-        die("fopen", state);
-    else printf("opened %s for reading\n", state->filename);
-    char *line = NULL;
-    size_t line_cap = 0;
-    ssize_t line_len;
-    while ((line_len = getline(&line, &line_cap, fp)) != -1) {
-        while (line_len > 0 && (line[line_len - 1] == '\n' || line[line_len - 1] == '\r'))
-            line_len--;
-        editor_insert_row(state, line, line_len, state->n_rows);
-    }
-    free(line);
-    fclose(fp);
+    size_t len = editor_map_file(state, filename);
+    LineIndex lines = state->lines;
+
+    // rows start out unloaded. Small files load all of them now; big ones only what gets
+    // looked at, so opening costs the same whatever the size
+    state->n_rows = lines.count;
+    state->row = calloc(state->n_rows ? state->n_rows : 1, sizeof(e_row *));
+    state->hl_state = calloc(state->n_rows ? state->n_rows : 1, 1);
+    if (state->row == NULL || state->hl_state == NULL)
+        die("calloc", state);
+    state->hl_frontier = 0;
+    state->lazy_rows = len >= LAZY_FILE_SIZE;
+    if (state->lazy_rows) {
+        state->load_ring = malloc(LAZY_ROW_CACHE * sizeof(size_t));
+        if (state->load_ring == NULL)
+            die("malloc", state);
+        memset(state->load_ring, 0xff, LAZY_ROW_CACHE * sizeof(size_t));
+        state->load_ring_pos = 0;
+    }
+    else {
+        for (size_t i = 0; i < state->n_rows; i++)
+            editor_row(state, i);
+    }
     state->dirty = 0;
 }
 
+// Bytes of the document that go in the file: it ends in one newline, however many empty
+// rows the document ends with, and that newline is written after them.
+static size_t editor_file_len(struct editor_state *state) {
+    size_t len = state->doc.len;
+    char c;
+    while (len > 0 && piece_table_read(&state->doc, len - 1, 1, &c) == 1 && c == '\n')
+        len--;
+    return len;
+}
+
+// Copies from's bytes from its current offset on to fd. Returns -1 if a read or write fails.
+static int copy_fd(int from, int fd) {
+    char buf[64 * 1024];
+    ssize_t n;
+    while ((n = read(from, buf, sizeof(buf))) != 0) {
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n == -1)
+            return -1;
+        for (ssize_t done = 0; done < n;) {
+            ssize_t w = write(fd, &buf[done], n - done);
+            if (w == -1 && errno != EINTR)
+                return -1;
+            if (w > 0)
+                done += w;
+        }
+    }
+    return 0;
+}
+
+// Writes the document over path's own bytes, for a file that can't be replaced by a new one.
+// The pieces may point into the mapping of this very file, so the text goes to a temporary
+// file first and is copied over from there; as the mapping then shows the new text, the
+// document is started again over the file, which holds what it did. Returns the number of
+// bytes written, or -1 with errno set.
+static ssize_t editor_write_in_place(struct editor_state *state, const char *path) {
+    size_t len = editor_file_len(state);
+    FILE *spill = tmpfile();
+    if (spill == NULL)
+        return -1;
+    int from = fileno(spill);
+    int fd = -1;
+    int failed = piece_table_write(&state->doc, from, len) != 0 || write(from, "\n", 1) != 1 ||
+                 lseek(from, 0, SEEK_SET) == -1 || (fd = open(path, O_WRONLY)) == -1 ||
+                 copy_fd(from, fd) != 0 || ftruncate(fd, len + 1) == -1 || fsync(fd) == -1;
+    int saved = errno;
+    if (fd != -1 && close(fd) == -1 && !failed) {
+        failed = 1;
+        saved = errno;
+    }
+    fclose(spill);
+    if (failed) {
+        errno = saved;
+        return -1;
+    }
+    if (state->map) {
+        size_t doc_len = state->doc.len;
+        editor_map_file(state, path);
+        // put back the empty rows the file has one newline for
+        for (size_t at = state->doc.len; at < doc_len; at++) {
+            if (piece_table_insert(&state->doc, at, "\n", 1) != 0)
+                die("piece_table_insert", state);
+        }
+        if (doc_len < state->doc.len && piece_table_delete(&state->doc, doc_len, state->doc.len - doc_len) != 0)
+            die("piece_table_delete", state);
+    }
+    return len + 1;
+}
+
+// Writes the document to a temporary file next to filename, syncs it and renames it over
+// filename, so the file is only ever the old text or the new. A symlink is followed, so the
+// file it points at is the one replaced, and the new file gets the old one's mode, owner and
+// group. A file with other hard links, in a directory that files can't be made in or whose
+// owner can't be kept is written in place instead. The text goes out of the pieces as it is,
+// never gathered into one buffer; the old file stays mapped under the pieces that still point
+// into it, as renaming over it doesn't free it. Returns the number of bytes written, or -1
+// with errno set.
+static ssize_t editor_write_file(struct editor_state *state, const char *filename) {
+    char *path = realpath(filename, NULL);
+    if (path == NULL && (errno != ENOENT || (path = strdup(filename)) == NULL))
+        return -1;
+    struct stat st;
+    int exists = stat(path, &st) == 0;
+    const char *slash = strrchr(path, '/');
+    char *dir = slash ? strndup(path, slash - path + 1) : strdup(".");
+    if (dir == NULL) {
+        free(path);
+        return -1;
+    }
+    if (exists && (st.st_nlink > 1 || access(dir, W_OK) != 0)) {
+        ssize_t written = editor_write_in_place(state, path);
+        free(dir);
+        free(path);
+        return written;
+    }
+
+    size_t len = editor_file_len(state);
+    size_t path_len = strlen(path);
+    char *tmp = malloc(path_len + 8);
+    int fd = -1;
+    if (tmp != NULL) {
+        memcpy(tmp, path, path_len);
+        memcpy(&tmp[path_len], ".XXXXXX", 8);
+        fd = mkstemp(tmp);
+    }
+    if (fd == -1) {
+        int saved = errno;
+        free(tmp);
+        free(dir);
+        free(path);
+        errno = saved;
+        return -1;
+    }
+    if (exists && fchown(fd, st.st_uid, st.st_gid) == -1) {
+        // only root can give a file away, so one that isn't ours keeps its inode
+        close(fd);
+        unlink(tmp);
+        free(tmp);
+        free(dir);
+        ssize_t written = editor_write_in_place(state, path);
+        free(path);
+        return written;
+    }
+    mode_t mode = exists ? st.st_mode & 07777 : 0644;
+    int failed = fchmod(fd, mode) == -1 || piece_table_write(&state->doc, fd, len) != 0 ||
+                 write(fd, "\n", 1) != 1 || fsync(fd) == -1;
+    if (close(fd) == -1)
+        failed = 1;
+    if (failed || rename(tmp, path) == -1) {
+        int saved = errno;
+        unlink(tmp);
+        free(tmp);
+        free(dir);
+        free(path);
+        errno = saved;
+        return -1;
+    }
+    free(tmp);
+    free(path);
+    // the rename itself is only on disk once the directory is
+    int dir_fd = open(dir, O_RDONLY);
+    if (dir_fd != -1) {
+        fsync(dir_fd);
+        close(dir_fd);
+    }
+    free(dir);
+    return len + 1;
+}
+
 void editor_save_file(struct editor_state *state) {
     if (state->filename == NULL) {
         state->filename = e_get_prompt_response(state, "Enter filename: %s", NULL);
@@ -73,94 +417,92 @@ void editor_save_file(struct editor_state *state) {
         }
         editor_select_highlight(state);
     }
-    int len;
-    char *buf = editor_rows_to_string(state, &len);
-    char *p = buf + len;
-    char *filename = strdup(state->filename);
-    size_t cx = state->cx;
-    size_t cy = state->cy;
-
-    while (*--p == '\n') {
-        *p = '\0';
-        len -= 1;
-    }
-    len += 1;
-    *++p = '\n';
-    int fd = open(filename, O_RDWR | O_CREAT, 0644);
-    if (fd != -1) {
-        if (ftruncate(fd, len) != -1) {
-            if (write(fd, buf, len) == len) {
-                close(fd);
-                free(buf);
-                init_editor(state);
-                editor_open_file(state, filename);
-                state->cx = cx;
-                state->cy = cy;
-                if (cy > state->n_rows) {
-                    state->cy -= (cy - state->n_rows);
-                }
-                editor_set_status(state, "wrote %d bytes to disk", len);
-                return;
-            }
-        }
-        close(fd);
+    ssize_t written = editor_write_file(state, state->filename);
+    if (written == -1) {
+        editor_set_status(state, "Can't save! I/O error: %s", strerror(errno));
+        return;
     }
-    free(filename);
-    free(buf);
+    // the rows already are what was written, so nothing is read back
+    state->dirty = 0;
+    editor_set_status(state, "wrote %zd bytes to disk", written);
 }
 
-void e_draw_message_bar(struct editor_state *state, struct abuf *ab) {
-    ab_append(ab, "\33[1m", 4);
-    ab_append(ab, "\x1b[K", 4);
-    int msg_len = strlen(state->status_msg);
-    if (msg_len > (int) state->cols) msg_len = state->cols;
-    if (msg_len && time(NULL) - state->status_time < STATUS_TIMEOUT)
-        ab_append(ab, state->status_msg, msg_len);
-    ab_append(ab, "\33[1m", 5);
-    ab_append(ab, "\r\n", 2);
+void e_draw_message_bar(struct editor_state *state, size_t y) {
+    struct cell *line = screen_row(&state->screen, y);
+    size_t msg_len = strlen(state->status_msg);
+    if (msg_len > state->cols) msg_len = state->cols;
+    if (!(time(NULL) - state->status_time < STATUS_TIMEOUT))
+        msg_len = 0;
+    for (size_t x = 0; x < msg_len; x++) {
+        line[x] = (struct cell) { state->status_msg[x], CELL_DEFAULT_COLOR, CELL_BOLD };
+    }
+    screen_end_row(&state->screen, y, msg_len);
 }
 
 void editor_insert_row(struct editor_state *state, char *s, size_t len, size_t at) {
     if (at > state->n_rows)
         return;
-    state->row = realloc(state->row, sizeof(e_row) * (state->n_rows + 1));
-    memmove(&state->row[at + 1], &state->row[at], sizeof(e_row) * (state->n_rows - at));
-    for (int j = at + 1; j <= state->n_rows; j++) state->row[j].idx++;
-
-    state->row[at].size = len;
-    state->row[at].chars = calloc(len + 1, 1);
-    memcpy(state->row[at].chars, s, len);
-    state->row[at].chars[len] = '\0';
-    state->row[at].render_size = 0;
-    state->row[at].render = NULL;
-    state->row[at].hl = NULL;
-    state->row[at].idx = at;
-    state->row[at].hl_open_comment = 0;
-    editor_update_row(state, &state->row[at]);
+    e_row **rows = realloc(state->row, sizeof(e_row *) * (state->n_rows + 1));
+    if (rows)
+        state->row = rows;
+    unsigned char *hl_state = realloc(state->hl_state, state->n_rows + 1);
+    if (hl_state)
+        state->hl_state = hl_state;
+    e_row *row = calloc(1, sizeof(e_row));
+    if (rows == NULL || hl_state == NULL || row == NULL)
+        die("editor_insert_row", state);
+    memmove(&state->row[at + 1], &state->row[at], sizeof(e_row *) * (state->n_rows - at));
+    memmove(&state->hl_state[at + 1], &state->hl_state[at], state->n_rows - at);
+    state->hl_state[at] = 0;
+
+    row->size = len;
+    row->chars = calloc(len + 1, 1);
+    memcpy(row->chars, s, len);
+    row->chars[len] = '\0';
+    if (row_index_build(&row->index, row->chars, len) != 0)
+        die("row_index_build", state);
+    state->row[at] = row;
+    editor_update_row(state, at);
     state->n_rows++;
+    if (state->lazy_rows)
+        editor_track_loaded_row(state, at);
     state->dirty++;
+    editor_doc_insert(state, at, 0, s, len);
+    editor_doc_insert(state, at, len, "\n", 1);
 }
-void editor_draw_status(struct editor_state *state, struct abuf *ab) {
-    ab_append(ab, "\x1b[7m", 5);
+void editor_draw_status(struct editor_state *state, size_t y) {
+    struct cell *line = screen_row(&state->screen, y);
     char status[80], rstatus[80];
     size_t len = snprintf(status, sizeof(status), "%.20s - %zu lines %s", state->filename ? state->filename : "[No Name]", state->n_rows,
                           state->dirty ? "(modified)" : "");
-    int rlen = snprintf(rstatus, sizeof(rstatus), "%s | %d/%d",
-                        state->syntax ? state->syntax->filetype : "no filetype", state->cy + 1, state->n_rows);
+    size_t rlen = 0;
+    if (state->search.query) {
+        if (state->search.bad_pattern)
+            rlen = snprintf(rstatus, sizeof(rstatus), "bad pattern | ");
+        else if (state->search.n_matches)
+            rlen = snprintf(rstatus, sizeof(rstatus), "match %zu/%zu%s | ", state->search.current + 1, state->search.n_matches,
+                            state->search.complete ? "" : "+");
+        else if (state->search.complete)
+            rlen = snprintf(rstatus, sizeof(rstatus), "no matches | ");
+        else
+            rlen = snprintf(rstatus, sizeof(rstatus), "searching | ");
+    }
+    rlen += snprintf(&rstatus[rlen], sizeof(rstatus) - rlen, "%s | %zu/%zu",
+                     state->syntax ? state->syntax->filetype : "no filetype", state->cy + 1, state->n_rows);
+    if (rlen >= sizeof(rstatus))
+        rlen = sizeof(rstatus) - 1;
     if (len > state->cols)
         len = state->cols;
-    ab_append(ab, status, len);
-    while (len < state->cols) {
-        if (state->cols - len == rlen) {
-            ab_append(ab, rstatus, rlen);
-            break;
-        }
-        else {
-            ab_append(ab, " ", 2);
-            len++;
-        }
+    // the message bar's bold has always carried on into the status bar
+    for (size_t x = 0; x < state->cols; x++) {
+        char c = ' ';
+        if (x < len)
+            c = status[x];
+        else if (state->cols - len >= rlen && x >= state->cols - rlen)
+            c = rstatus[x - (state->cols - rlen)];
+        line[x] = (struct cell) { c, CELL_DEFAULT_COLOR, CELL_REVERSE | CELL_BOLD };
     }
-    ab_append(ab, "\x1b[m", 4);
+    screen_end_row(&state->screen, y, state->cols);
 }
 
 void editor_set_status(struct editor_state *state, const char *fmt, ...) {
@@ -171,54 +513,114 @@ void editor_set_status(struct editor_state *state, const char *fmt, ...) {
     state->status_time = time(NULL);
 }
 
-void editor_draw_rows(struct editor_state *state, struct abuf *ab) {
+// Colours a row's matches as they are found, working out render columns going along the row
+// once rather than from its start per match. Only chars[cx..to) are on screen.
+struct match_colors {
+    struct editor_state *state;
+    e_row *row;
+    struct cell *line; // cells from column_offset on
+    size_t len;
+    size_t cx;
+    size_t rx;
+    size_t to;
+};
+
+static int color_match(void *arg, size_t from, size_t to) {
+    struct match_colors *mc = arg;
+    struct editor_state *state = mc->state;
+    unsigned char color = editor_syntax_to_color(HL_MATCH);
+    if (from >= mc->to)
+        return 1;
+    for (; mc->cx < from; mc->cx++) mc->rx = row_rx_after(mc->row->chars[mc->cx], mc->rx);
+    // a match overlapping the last one only needs colouring past where that one ended
+    size_t from_rx = mc->rx;
+    for (; mc->cx < to && mc->cx < mc->to; mc->cx++) mc->rx = row_rx_after(mc->row->chars[mc->cx], mc->rx);
+    for (size_t x = from_rx; x < mc->rx; x++) {
+        if (x >= state->column_offset && x - state->column_offset < mc->len)
+            mc->line[x - state->column_offset].color = color;
+    }
+    return 0;
+}
+
+// Colours every match of the search in row, whose cells from column_offset on are in line
+// and show chars[cx..to), cx starting at column rx.
+static void editor_draw_matches(struct editor_state *state, e_row *row, struct cell *line, size_t len,
+                                size_t cx, size_t rx, size_t to) {
+    struct match_colors mc = { state, row, line, len, cx, rx, to };
+    if (state->search.regex) {
+        if (regex_line_matches(state->search.regex, row->chars, row->size, color_match, NULL, &mc) != 0)
+            die("regex_line_matches", state);
+        return;
+    }
+    // a plain query can only match on screen if it starts less than its length before it
+    const char *query = state->search.query;
+    size_t query_len = state->search.query_len;
+    const char *end = &row->chars[to + query_len - 1 < row->size ? to + query_len - 1 : row->size];
+    const char *match = &row->chars[cx >= query_len ? cx - query_len + 1 : 0];
+    while (match < end && (match = memmem(match, end - match, query, query_len))) {
+        color_match(&mc, match - row->chars, match - row->chars + query_len);
+        match++;
+    }
+}
+
+void editor_draw_rows(struct editor_state *state) {
     for (size_t y = 0; y < state->rows; y++) {
-        size_t file_row = y +state->row_offset;
+        struct cell *line = screen_row(&state->screen, y);
+        size_t file_row = y + state->row_offset;
+        size_t len = 0;
         if (file_row >= state->n_rows || (state->n_rows == 0 && state->filename == NULL)) {
-            ab_append(ab, "~", 1);
+            line[len++] = (struct cell) { '~', CELL_DEFAULT_COLOR, 0 };
         }
         else {
-            int len = state->row[file_row].render_size - state->column_offset;
-            if (len < 0) len = 0;
-            if (len > (int) state->cols) len = state->cols;
-            //ab_append(ab, &state->row[file_row].render[state->column_offset], len);
-            unsigned char *hl = &state->row[file_row].hl[state->column_offset];
-            char *c = &state->row[file_row].render[state->column_offset];
-            int current_color = -1;
-            for (size_t j = 0; j < len; j++) {
-                if (iscntrl(c[j])) {
-                    char sym = (c[j] <= 26) ? '@' + c[j] : '?';
-                    ab_append(ab, "\x1b[7m", 4);
-                    ab_append(ab, &sym, 1);
-                    ab_append(ab, "\x1b[m", 3);
-                    if (current_color != -1) {
-                        char buf[16];
-                        int clen = snprintf(buf, sizeof(buf), "\x1b[%dm", current_color);
-                        ab_append(ab, buf, clen);
+            e_row *row = editor_row(state, file_row);
+            // only the bytes on screen are rendered and highlighted, however long the row is:
+            // no more than one per column from the one at column_offset
+            size_t rx;
+            size_t cx = row_index_rx_to_cx(&row->index, row->chars, state->column_offset, &rx);
+            size_t to = row->size - cx > state->cols ? cx + state->cols : row->size;
+            editor_highlight_row(state, file_row, cx, to);
+            const char *c = &row->chars[row->hl_from];
+            const unsigned char *hl = row->hl;
+            size_t j = cx - row->hl_from;
+            size_t end = to - row->hl_from;
+            // one colour lookup per run of equal highlight
+            unsigned char color = CELL_DEFAULT_COLOR;
+            while (j < end && len < state->cols) {
+                if (c[j] == '\t') {
+                    // a tab cut by the left edge shows only its columns from column_offset on
+                    size_t x = len ? state->column_offset + len : rx;
+                    size_t next = row_rx_after('\t', x);
+                    color = hl[j] == HL_NORMAL ? CELL_DEFAULT_COLOR : editor_syntax_to_color(hl[j]);
+                    for (; x < next && len < state->cols; x++) {
+                        if (x >= state->column_offset)
+                            line[len++] = (struct cell) { ' ', color, 0 };
                     }
+                    j++;
+                    continue;
                 }
-                else if (hl[j] == HL_NORMAL) {
-                        if (current_color != -1) {
-                            ab_append(ab, "\x1b[39m", 5);
-                            current_color = -1;
-                        }
-                        ab_append(ab, &c[j], 1);
-                    }
-                    else {
-                        int color = editor_syntax_to_color(hl[j]);
-                        if (color != current_color) {
-                            current_color = color;
-                            char buf[16];
-                            int clen = snprintf(buf, sizeof(buf), "\x1b[%dm", color);
-                            ab_append(ab, buf, clen);
-                        }
-                        ab_append(ab, &c[j], 1);
-                    }
+                if (iscntrl((unsigned char) c[j])) {
+                    // shown inverted, in the colour of what came before it
+                    char sym = (c[j] <= 26) ? '@' + c[j] : '?';
+                    line[len++] = (struct cell) { sym, color, CELL_REVERSE };
+                    j++;
+                    continue;
+                }
+                size_t run = j + 1;
+                while (run < end && hl[run] == hl[j] && c[run] != '\t' && !iscntrl((unsigned char) c[run])) run++;
+                if (run - j > state->cols - len)
+                    run = j + state->cols - len;
+                color = hl[j] == HL_NORMAL ? CELL_DEFAULT_COLOR : editor_syntax_to_color(hl[j]);
+                for (; j < run; j++) {
+                    line[len].ch = c[j];
+                    line[len].color = color;
+                    line[len].style = 0;
+                    len++;
                 }
-            ab_append(ab, "\x1b[39m", 5);
+            }
+            if (state->search.query && !state->search.bad_pattern)
+                editor_draw_matches(state, row, line, len, cx, rx, to);
         }
-        ab_append(ab, "\x1b[K", 4);
-        ab_append(ab, "\r\n", 2);
+        screen_end_row(&state->screen, y, len);
     }
 }
 
@@ -226,7 +628,7 @@ void editor_scroll(struct editor_state *state) {
     state->rx = state->cx;
     state->rx = 0;
     if (state->cy < state->n_rows) {
-        state->rx = e_row_cx_to_rx(&state->row[state->cy], state->cx);
+        state->rx = e_row_cx_to_rx(editor_row(state, state->cy), state->cx);
     }
     if (state->cy < state->row_offset) {
         state->row_offset = state->cy;
@@ -244,49 +646,130 @@ void editor_scroll(struct editor_state *state) {
 
 void editor_refresh_screen(struct editor_state* state) {
     editor_scroll(state);
+    if (screen_resize(&state->screen, state->rows + STATUSLINE_COUNT, state->cols) != 0)
+        die("screen_resize", state);
+    editor_draw_rows(state);
+    e_draw_message_bar(state, state->rows);
+    editor_draw_status(state, state->rows + 1);
 
-    struct abuf ab = ABUF_INIT;
-    ab_append(&ab, "\x1b[?25l", 6); // hide cursor
-    ab_append(&ab, "\x1b[H", 3);
-    editor_draw_rows(state, &ab);
-
-    e_draw_message_bar(state, &ab);
-    editor_draw_status(state, &ab);
+    // only what changed since the last frame is written
+    struct abuf *ab = &state->screen.out;
+    ab->len = 0;
+    ab_append(ab, "\x1b[?25l", 6); // hide cursor
+    screen_flush(&state->screen, ab);
 
     char buf[32];
-    snprintf(buf, sizeof(buf), "\x1b[%zu;%zuH", (state->cy - state->row_offset) + 1, state->rx + 1);
-    ab_append(&ab, buf, strlen(buf));
-    ab_append(&ab, "\x1b[?25h", 6); // show cursor
-    write(STDOUT_FILENO, ab.b, ab.len);
-    ab_free(&ab);
+    int len = snprintf(buf, sizeof(buf), "\x1b[%zu;%zuH", (state->cy - state->row_offset) + 1, state->rx + 1);
+    ab_append(ab, buf, len);
+    ab_append(ab, "\x1b[?25h", 6); // show cursor
+    write(STDOUT_FILENO, ab->b, ab->len);
+}
+
+// Reads whatever input has come in onto the end of state->input, without waiting. Returns
+// the number of bytes read.
+static size_t editor_fill_input(struct editor_state *state) {
+    if (state->input_pos > 0) {
+        memmove(state->input, &state->input[state->input_pos], state->input_len - state->input_pos);
+        state->input_len -= state->input_pos;
+        state->input_pos = 0;
+    }
+    if (state->input_len == sizeof(state->input))
+        return 0;
+    ssize_t n = read(STDIN_FILENO, &state->input[state->input_len], sizeof(state->input) - state->input_len);
+    if (n == -1 && errno != EAGAIN && errno != EINTR)
+        die("read", state);
+    if (n <= 0)
+        return 0;
+    state->input_len += n;
+    return n;
+}
+
+// Sleeps in poll() until input comes in, the search workers find more (if search is set)
+// or timeout_ms go by, -1 meaning for ever. Returns 0 if the time ran out, 1 if not.
+static int editor_poll(struct editor_state *state, int timeout_ms, int search) {
+    struct pollfd fds[2] = {{ STDIN_FILENO, POLLIN, 0 }, { search ? search_fd(&state->search) : -1, POLLIN, 0 }};
+    int n = poll(fds, 2, timeout_ms);
+    if (n == -1 && errno != EINTR)
+        die("poll", state);
+    if (n <= 0)
+        return 0;
+    if (fds[0].revents)
+        editor_fill_input(state);
+    return 1;
+}
+
+int editor_input_pending(struct editor_state *state) {
+    return state->input_pos < state->input_len;
+}
+
+int editor_wait_input(struct editor_state *state) {
+    if (editor_input_pending(state))
+        return 1;
+    int timeout = -1;
+    time_t shown = time(NULL) - state->status_time;
+    // whole seconds, the way e_draw_message_bar counts, so no wake up comes too early
+    if (state->status_msg[0] && shown < STATUS_TIMEOUT)
+        timeout = (STATUS_TIMEOUT - shown) * 1000;
+    return editor_poll(state, timeout, 1);
 }
 
+// The byte i past the next one to be decoded, waiting up to ESC_WAIT_MS for it to come in
+// as the rest of an escape sequence. -1 if it doesn't.
+static int editor_input_at(struct editor_state *state, size_t i) {
+    while (state->input_pos + i >= state->input_len) {
+        if (state->input_len - state->input_pos == sizeof(state->input) || !editor_poll(state, ESC_WAIT_MS, 0))
+            return -1;
+    }
+    return (unsigned char) state->input[state->input_pos + i];
+}
+
+// Decodes the next key from state->input, waiting for more first if it is empty. What one
+// read brought in is all decoded before the next, so keys that come in together are taken
+// one after another and drawn once, and keys that keep coming in can't hold off a frame.
 int editor_read_key(struct editor_state *state) {
-  int nread;
-  char c;
-  while ((nread = read(STDIN_FILENO, &c, 1)) != 1) {
-    if (nread == -1 && errno != EAGAIN) die("read", state);
+  while (!editor_input_pending(state)) {
+    // what the search workers find comes in between keys
+    if (search_pending(&state->search)) return SEARCH_RESULTS;
+    editor_poll(state, -1, 1);
   }
-  if (c == '\x1b') {
-    char seq[3];
-    if (read(STDIN_FILENO, &seq[0], 1) != 1) return '\x1b';
-    if (read(STDIN_FILENO, &seq[1], 1) != 1) return '\x1b';
-    if (seq[0] == '[') {
-        if (seq[1] >= '0' && seq[1] <= '9') {
-            if (read(STDIN_FILENO, &seq[2], 1) != 1) return '\x1b';
-            if (seq[2] == '~') {
-                switch (seq[1]) {
-                    case '5': return PAGE_UP;
-                    case '3': return DEL;
-                    case '6': return PAGE_DOWN;
-                    case '1': return HOME;
-                    case '4': return END;
-                    case '7': return HOME;
-                    case '8': return END;
-                }
+  int c = (unsigned char) state->input[state->input_pos++];
+  if (c != '\x1b')
+    return c;
+  int seq0 = editor_input_at(state, 0);
+  // a lone ESC, or ESC and then a key of its own
+  if (seq0 != '[' && seq0 != 'O')
+    return '\x1b';
+  int seq1 = editor_input_at(state, 1);
+  if (seq1 == -1)
+    return '\x1b';
+  state->input_pos += 2;
+  if (seq0 == '[') {
+    if (seq1 >= '0' && seq1 <= '9') {
+      // ESC [ number ~
+      int num = seq1 - '0';
+      int next;
+      size_t i = 0;
+      while ((next = editor_input_at(state, i)) >= '0' && next <= '9' && num < 1000) {
+        num = num * 10 + next - '0';
+        i++;
+      }
+      if (next == -1)
+        return '\x1b';
+      state->input_pos += i + 1;
+      if (next == '~') {
+        switch (num) {
+          case 5: return PAGE_UP;
+          case 3: return DEL;
+          case 6: return PAGE_DOWN;
+          case 1: return HOME;
+          case 4: return END;
+          case 7: return HOME;
+          case 8: return END;
+          case 200: return PASTE_START;
         }
+      }
     } else {
-      switch (seq[1]) {
+      switch (seq1) {
         case 'A': return ARROW_UP;
         case 'B': return ARROW_DOWN;
         case 'C': return ARROW_RIGHT;
@@ -294,20 +777,88 @@ int editor_read_key(struct editor_state *state) {
         case 'H': return HOME;
         case 'F': return END;
       }
-    }    } else if (seq[0] == 'O') {
-      switch (seq[1]) {
-        case 'H': return HOME;
-        case 'F': return END;
-      }
-  }
-    return '\x1b';
+    }
   } else {
-    return c;
+    switch (seq1) {
+      case 'H': return HOME;
+      case 'F': return END;
+    }
   }
+  return '\x1b';
+}
+
+// Reads what the terminal sends after ESC [ 200 ~ up to ESC [ 201 ~ as text, its \r and
+// \r\n line ends made \n, and sets *len to its length. If the end doesn't come within
+// PASTE_WAIT_MS of the last byte, the paste is taken to be over. Returns NULL if malloc
+// fails.
+static char *editor_read_paste(struct editor_state *state, size_t *len) {
+    static const char end[] = "\x1b[201~";
+    size_t cap = INPUT_BUF_SIZE;
+    size_t n = 0;
+    char *text = malloc(cap);
+    if (text == NULL)
+        return NULL;
+    for (;;) {
+        if (!editor_input_pending(state) && (!editor_poll(state, PASTE_WAIT_MS, 0) || !editor_input_pending(state)))
+            break;
+        const char *at = &state->input[state->input_pos];
+        size_t avail = state->input_len - state->input_pos;
+        const char *esc = memchr(at, '\x1b', avail);
+        size_t take = esc ? (size_t) (esc - at) : avail;
+        if (n + take + 1 > cap) {
+            while (n + take + 1 > cap)
+                cap *= 2;
+            char *grown = realloc(text, cap);
+            if (grown == NULL) {
+                free(text);
+                return NULL;
+            }
+            text = grown;
+        }
+        memcpy(&text[n], at, take);
+        n += take;
+        state->input_pos += take;
+        if (esc) {
+            // any other ESC is part of what was pasted
+            size_t i = 1;
+            while (i < sizeof(end) - 1 && editor_input_at(state, i) == end[i])
+                i++;
+            if (i == sizeof(end) - 1) {
+                state->input_pos += i;
+                break;
+            }
+            text[n++] = '\x1b';
+            state->input_pos++;
+        }
+    }
+    size_t out = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (text[i] == '\r') {
+            text[out++] = '\n';
+            if (i + 1 < n && text[i + 1] == '\n')
+                i++;
+        }
+        else {
+            text[out++] = text[i];
+        }
+    }
+    *len = out;
+    return text;
+}
+
+static void editor_paste(struct editor_state *state) {
+    size_t len;
+    char *text = editor_read_paste(state, &len);
+    if (text == NULL)
+        die("editor_read_paste", state);
+    editor_insert_text(state, text, len);
+    free(text);
 }
 
 void editor_process_keypress(struct editor_state *state) {
     int c = editor_read_key(state);
+    // whatever one key changes is undone in one go
+    undo_begin(&state->undo, state->cx, state->cy);
     switch (c) {
     case CTRL_KEY('q'):
         if (state->dirty) {
@@ -336,13 +887,24 @@ void editor_process_keypress(struct editor_state *state) {
         editor_set_status(state, "Clipboard not implemented yet.");
     break;
     case CTRL_KEY('z'):
-        editor_set_status(state, "Undo not implemented yet.");
+        editor_undo(state, 0);
+    break;
+    case CTRL_KEY('y'):
+        editor_undo(state, 1);
     break;
     case CTRL_KEY('s'):
         editor_save_file(state);
     break;
     case CTRL_KEY('f'):
-        editor_find(state);
+        editor_find(state, 0);
+    break;
+    case CTRL_KEY('r'):
+        editor_find(state, 1);
+    break;
+    case SEARCH_RESULTS:
+    break;
+    case PASTE_START:
+        editor_paste(state);
     break;
     case ARROW_UP:
     case ARROW_DOWN:
@@ -370,7 +932,7 @@ void editor_process_keypress(struct editor_state *state) {
         break;
     case END:
         if (state->cy < state->n_rows)
-            state->cx = state->row[state->cy].size;
+            state->cx = editor_row(state, state->cy)->size;
     break;
     case '\r':
         if (state->cy == state->n_rows) {
@@ -395,11 +957,12 @@ void editor_process_keypress(struct editor_state *state) {
     default: editor_insert_char(state, c);
         break;
     }
+    undo_end(&state->undo, state->cx, state->cy);
     state->last_key = c;
 }
 
 void editor_move_cursor(struct editor_state *state, int key) {
-    e_row *row = (state->cy >= state->n_rows) ? NULL : &state->row[state->cy];
+    e_row *row = (state->cy >= state->n_rows) ? NULL : editor_row(state, state->cy);
     switch (key) {
     case ARROW_LEFT:
         if (state->cx != 0) {
@@ -409,7 +972,7 @@ void editor_move_cursor(struct editor_state *state, int key) {
             if (state->cy > 0) {
                 state->cy--;
                 state->column_offset--;
-                state->cx = state->row[state->cy].size + 1;
+                state->cx = editor_row(state, state->cy)->size + 1;
             }
         }
         break;
@@ -430,7 +993,7 @@ void editor_move_cursor(struct editor_state *state, int key) {
         }
         break;
     }
-    row = (state->cy >= state->n_rows) ? NULL : &state->row[state->cy];
+    row = (state->cy >= state->n_rows) ? NULL : editor_row(state, state->cy);
     if (!row) return;
     size_t row_len = row ? row->size : 0;
     if (row_len < state->cols && state->column_offset != 0) {
@@ -441,77 +1004,34 @@ void editor_move_cursor(struct editor_state *state, int key) {
     }
 }
 
-char *editor_rows_to_string(struct editor_state *state, int *buf_len) {
-    int tot_len = 0;
-    for (size_t j = 0; j < state->n_rows; j++)
-        tot_len += state->row[j].size + 1;
-    *buf_len = tot_len;
-    char *buf = malloc(tot_len);
-    char *p = buf;
-    for (size_t j = 0; j < state->n_rows; j++) {
-        memcpy(p, state->row[j].chars, state->row[j].size);
-        p += state->row[j].size;
-        *p = '\n';
-        p++;
-    }
-    return buf;
-}
-
-void editor_update_row(struct editor_state *state, e_row *row) {
-    int tabs = 0;
-    for (size_t j = 0; j <= row->size; j++) {
-        if (row->chars[j] == '\t') tabs++;
-    }
-    free(row->render);
-    row->render = malloc(row->size + (tabs * (TAB_SIZE - 1)) + 1);
-
-    int idx = 0;
-    for (size_t j = 0; j < row->size; j++) {
-        if (row->chars[j] == '\t') {
-            row->render[idx++] = ' ';
-            while (idx % TAB_SIZE != 0) row->render[idx++] = ' ';
-        }
-        else {
-            row->render[idx++] = row->chars[j];
-        }
-    }
-    row->render[idx] = '\0';
-    row->render_size = idx;
-    editor_update_syntax(state, row);
+// Called after row at's text has changed, and its index with it.
+void editor_update_row(struct editor_state *state, size_t at) {
+    editor_invalidate_highlight(state, at);
 }
 
 int e_row_cx_to_rx(e_row *row, int cx) {
-    int rx = 0;
-    int j;
-    for (j = 0; j < cx; j++) {
-        if (row->chars[j] == '\t')
-            rx += (TAB_SIZE - 1) - (rx % TAB_SIZE);
-        rx++;
-    }
-    return rx;
+    return row_index_cx_to_rx(&row->index, row->chars, cx);
 }
 
 int e_row_rx_to_cx(e_row *row, int rx) {
-  int cur_rx = 0;
-  size_t cx;
-  for (cx = 0; cx < row->size; cx++) {
-    if (row->chars[cx] == '\t')
-      cur_rx += (TAB_SIZE - 1) - (cur_rx % TAB_SIZE);
-    cur_rx++;
-    if (cur_rx > rx) return cx;
-  }
-  return cx;
+    size_t cx_rx;
+    return row_index_rx_to_cx(&row->index, row->chars, rx, &cx_rx);
 }
 
 
-void e_row_insert_char(struct editor_state *state, e_row *row, size_t at, int c) {
+void e_row_insert_char(struct editor_state *state, size_t y, size_t at, int c) {
+    e_row *row = editor_row(state, y);
     if (at > row->size)
         at = row->size;
+    char ch = c;
+    editor_doc_insert(state, y, at, &ch, 1);
     row->chars = realloc(row->chars, row->size + 2);
     memmove(&row->chars[at + 1], &row->chars[at], row->size - at + 1);
     row->size++;
     row->chars[at] = c;
-    editor_update_row(state, row);
+    if (row_index_insert(&row->index, row->chars, at, 1) != 0)
+        die("row_index_insert", state);
+    editor_update_row(state, y);
     state->dirty++;
 }
 
@@ -519,16 +1039,19 @@ void editor_insert_char(struct editor_state *state, int c) {
     if (state->cy == state->n_rows || state->cy == state->n_rows - 1) {
         editor_insert_row(state, "", 0, state->n_rows);
     }
-    e_row_insert_char(state, &state->row[state->cy], state->cx, c);
+    e_row_insert_char(state, state->cy, state->cx, c);
     state->cx++;
 }
 
-void e_row_delete_char(struct editor_state *state, e_row *row, size_t at) {
+void e_row_delete_char(struct editor_state *state, size_t y, size_t at) {
+    e_row *row = editor_row(state, y);
     if (at >= row->size)
         return;
+    editor_doc_delete(state, y, at, 1);
     memmove(&row->chars[at], &row->chars[at + 1], row->size - at);
     row->size--;
-    editor_update_row(state, row);
+    row_index_delete(&row->index, row->chars, at, 1);
+    editor_update_row(state, y);
     state->dirty++;
 }
 
@@ -538,52 +1061,80 @@ void editor_delete_char(struct editor_state *state) {
     }
     if (state->cx == 0 && state->cy == 0)
         return;
-    e_row *row = &state->row[state->cy];
+    e_row *row = editor_row(state, state->cy);
     if (state->cx > 0) {
         state->cx--;
-        e_row_delete_char(state, row, state->cx);
+        e_row_delete_char(state, state->cy, state->cx);
     } else {
-        state->cx = state->row[state->cy - 1].size;
-        editor_row_append_string(state, &state->row[state->cy - 1], row->chars, row->size);
+        state->cx = editor_row(state, state->cy - 1)->size;
+        editor_row_append_string(state, state->cy - 1, row->chars, row->size);
         editor_delete_row(state, state->cy);
         state->cy -= 1;
     }
 }
 
 void editor_free_row(e_row *row) {
-    free(row->render);
+    row_index_free(&row->index);
     free(row->chars);
     free(row->hl);
+    free(row);
 }
 void editor_delete_row(struct editor_state *state, size_t at) {
     if (at >= state->n_rows)
         return;
-    editor_free_row(&state->row[at]);
-    memmove(&state->row[at], &state->row[at + 1], sizeof(e_row) * (state->n_rows - at - 1));
-    for (int j = at; j < state->n_rows - 1; j++) state->row[j].idx--;
+    size_t start = piece_table_line_offset(&state->doc, at);
+    editor_doc_delete(state, at, 0, piece_table_line_offset(&state->doc, at + 1) - start);
+    if (state->row[at])
+        editor_free_row(state->row[at]);
+    memmove(&state->row[at], &state->row[at + 1], sizeof(e_row *) * (state->n_rows - at - 1));
+    memmove(&state->hl_state[at], &state->hl_state[at + 1], state->n_rows - at - 1);
+    if (at < state->hl_frontier)
+        state->hl_frontier = at; // the next line has a new line above it
     state->n_rows--;
     state->dirty++;
 }
 
-void editor_row_append_string(struct editor_state *state, e_row *row, char* s, size_t len) {
+void editor_row_append_string(struct editor_state *state, size_t at, char* s, size_t len) {
+    e_row *row = editor_row(state, at);
+    editor_doc_insert(state, at, row->size, s, len);
     row->chars = realloc(row->chars, row->size + len + 1);
     memcpy(&row->chars[row->size], s, len);
+    if (row_index_insert(&row->index, row->chars, row->size, len) != 0)
+        die("row_index_insert", state);
     row->size += len;
     row->chars[row->size] = '\0';
-    editor_update_row(state, row);
+    editor_update_row(state, at);
     state->dirty++;
 }
 
+// Inserts len bytes of text at the cursor, lines and all, and leaves the cursor after
+// them. It is one insert into the document and one move of the row array; the rows it
+// makes are loaded and highlighted when they are drawn.
+void editor_insert_text(struct editor_state *state, const char *s, size_t len) {
+    if (len == 0)
+        return;
+    if (state->cy == state->n_rows)
+        editor_insert_row(state, "", 0, state->n_rows);
+    size_t pos = piece_table_line_offset(&state->doc, state->cy) + state->cx;
+    if (undo_record(&state->undo, UNDO_INSERT, pos, s, len) != 0)
+        die("undo_record", state);
+    if (editor_apply_edit(state, UNDO_INSERT, pos, s, len) != 0)
+        die("editor_insert_text", state);
+    state->cy = piece_table_line_at(&state->doc, pos + len);
+    state->cx = pos + len - piece_table_line_offset(&state->doc, state->cy);
+}
+
 void editor_insert_newline(struct editor_state *state) {
   if (state->cx == 0) {
       editor_insert_row(state, "", 0, state->cy);
   } else {
-    e_row *row = &state->row[state->cy];
+    e_row *row = editor_row(state, state->cy);
     editor_insert_row(state, &row->chars[state->cx], row->size - state->cx, state->cy + 1);
-    row = &state->row[state->cy];
+    editor_doc_delete(state, state->cy, state->cx, row->size - state->cx);
+    row_index_delete(&row->index, row->chars, state->cx, row->size - state->cx);
     row->size = state->cx;
     row->chars[row->size] = '\0';
-    editor_update_row(state, row);
+    editor_update_row(state, state->cy);
   }
   state->cy++;
   state->cx = 0;
@@ -597,7 +1148,9 @@ char *e_get_prompt_response(struct editor_state *state, const char* prompt, void
         int c;
         while (1) {
             editor_set_status(state, prompt, buf);
-            editor_refresh_screen(state);
+            // keys that came in together are all taken before the prompt is drawn again
+            if (!editor_input_pending(state))
+                editor_refresh_screen(state);
             c = editor_read_key(state);
 
             if (c == DEL || c == CTRL_KEY('h') || c == BACKSPACE) {
@@ -616,6 +1169,24 @@ char *e_get_prompt_response(struct editor_state *state, const char* prompt, void
                         return buf;
                     }
                 }
+            else if (c == PASTE_START) {
+                size_t len;
+                char *text = editor_read_paste(state, &len);
+                if (text == NULL)
+                    die("editor_read_paste", state);
+                // the prompt is one line, so only what would have been typed into it is kept
+                for (size_t i = 0; i < len; i++) {
+                    if (iscntrl((unsigned char) text[i]) || (unsigned char) text[i] >= 128)
+                        continue;
+                    if (buf_len == buf_size - 1) {
+                        buf_size *= 2;
+                        buf = realloc(buf, buf_size);
+                    }
+                    buf[buf_len++] = text[i];
+                }
+                buf[buf_len] = '\0';
+                free(text);
+            }
             else if (!iscntrl(c) && c < 128) {
                 if (buf_len == buf_size - 1) {
                     buf_size *= 2;
@@ -636,12 +1207,13 @@ char *e_get_prompt_response(struct editor_state *state, const char* prompt, void
     }
 }
 
-void editor_find(struct editor_state *state) {
+void editor_find(struct editor_state *state, int regex) {
     size_t saved_cx = state->cx;
     size_t saved_cy = state->cy;
     size_t saved_coloff = state->column_offset;
     size_t saved_row_offset = state->row_offset;
-    char *query = e_get_prompt_response(state, "Search: %s (ESC to cancel)", editor_find_callback);
+    char *query = regex ? e_get_prompt_response(state, "Regex search: %s (ESC to cancel)", editor_find_regex_callback)
+                        : e_get_prompt_response(state, "Search: %s (ESC to cancel)", editor_find_callback);
     if (query) {
         free(query);
     }
@@ -654,56 +1226,54 @@ void editor_find(struct editor_state *state) {
 }
 
 
-void editor_find_callback(struct editor_state *state, char *query, int key) {
-    static int last_match = -1;
-    static int direction = 1;
-
-    static int saved_hl_line;
-    static char *saved_hl = NULL;
-    if (saved_hl) {
-        memcpy(state->row[saved_hl_line].hl, saved_hl, state->row[saved_hl_line].render_size);
-        free(saved_hl);
-        saved_hl = NULL;
-    }
+static void editor_find_step(struct editor_state *state, char *query, int key, int regex) {
+    struct search *search = &state->search;
     if (key == '\r' || key == '\x1b') {
-        last_match = -1;
-        direction = 1;
+        search_free(search);
         return;
-    } else if (key == ARROW_RIGHT || key == ARROW_DOWN) {
-        direction = 1;
-    } else if (key == ARROW_LEFT || key == ARROW_UP) {
-        direction = -1;
-    } else {
-        last_match = -1;
-        direction = 1;
-    }
-    if (last_match == -1)
-        direction = 1;
-    int current = last_match;
-
-    for (size_t i = 0; i < state->n_rows; i++) {
-        current += direction;
-        if (current == -1) current = state->n_rows - 1;
-        else if (current == (int) state->n_rows) current = 0;
-        
-        e_row *row = &state->row[current];
-        char *match = strstr(row->render, query);
-        if (match) {
-            last_match = current;
-            state->cy = current;
-            state->cx = e_row_rx_to_cx(row, match - row->render);
-            state->row_offset = state->n_rows;
-            saved_hl_line = current;
-            saved_hl = malloc(row->render_size);
-            memcpy(saved_hl, row->hl, row->render_size);
-            memset(&row->hl[match - row->render], HL_MATCH, strlen(query));
-            break;
-        }
     }
+    int step = 0;
+    if (key == SEARCH_RESULTS) {
+        size_t had = search->n_matches;
+        if (search_poll(search) < 0)
+            die("search_poll", state);
+        // only the first match to come in moves the cursor, the rest are there to go to
+        if (had)
+            return;
+    }
+    else if (key == ARROW_RIGHT || key == ARROW_DOWN)
+        step = 1;
+    else if (key == ARROW_LEFT || key == ARROW_UP)
+        step = -1;
+    else if (search_update(search, &state->doc, query, regex) != 0)
+        die("search_update", state);
+    // keys held down leave no time in between for the results to come in
+    if (step && search_poll(search) < 0)
+        die("search_poll", state);
+    if (step == 1 && search->current + 1 == search->n_matches && !search->complete) {
+        // going past the last match found so far looks for more rather than wrapping around
+        if (search_more(search) != 0)
+            die("search_more", state);
+        if (search->current + 1 == search->n_matches)
+            return;
+    }
+    if (search->n_matches == 0)
+        return;
+    search->current = (search->current + search->n_matches + step) % search->n_matches;
+
+    size_t pos = search->matches[search->current];
+    size_t line = piece_table_line_at(&state->doc, pos);
+    state->cy = line;
+    state->cx = pos - piece_table_line_offset(&state->doc, line);
+    state->row_offset = state->n_rows;
 }
 
-int is_separator(int c) {
-    return isspace(c) || c == '\0' || strchr(",.()+-/*=~%<>[];", c) != NULL;
+void editor_find_callback(struct editor_state *state, char *query, int key) {
+    editor_find_step(state, query, key, 0);
+}
+
+void editor_find_regex_callback(struct editor_state *state, char *query, int key) {
+    editor_find_step(state, query, key, 1);
 }
 
 int editor_syntax_to_color(int hl) {
@@ -733,9 +1303,15 @@ void editor_select_highlight(struct editor_state *state) {
             if ((is_ext && ext && !strcmp(ext, s->filematch[i])) ||
                 (!is_ext && strstr(state->filename, s->filematch[i]))) {
                 state->syntax = s;
+                // everything gets highlighted again as it comes into view
                 for (size_t file_row = 0; file_row < state->n_rows; file_row++) {
-                    editor_update_syntax(state, &state->row[file_row]);
+                    state->hl_state[file_row] = 0;
+                    if (state->row[file_row]) {
+                        state->row[file_row]->hl_valid = 0;
+                        row_index_invalidate(&state->row[file_row]->index);
+                    }
                 }
+                state->hl_frontier = 0;
 
                 return;
             }
@@ -2,16 +2,19 @@
 #define __EDITOR_H
 
 #include "highlighting.h"
+#include "line_index.h"
 #include "termutils.h"
 #include "structs.h"
 
 #include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <time.h>
 #include <termios.h>
@@ -22,29 +25,41 @@
 #define STATUSLINE_COUNT 2
 #define STATUS_TIMEOUT 2
 #define QUIT_CONFIRM_COUNT 3
+#define LAZY_FILE_SIZE (8 * 1024 * 1024) // files this big only load the rows they show
+#define LAZY_ROW_CACHE 4096               // rows a lazy file keeps loaded off screen
+#define ESC_WAIT_MS 50                    // how long the rest of an escape sequence has to come in
+#define PASTE_WAIT_MS 1000                // longest gap in a bracketed paste before it is taken as over
 
 #define CTRL_KEY(k) ((k)&0x1f)
 
-void editor_draw_rows(struct editor_state *state, struct abuf *ab);
+void editor_draw_rows(struct editor_state *state);
 void editor_refresh_screen(struct editor_state *state);
 void init_editor(struct editor_state *state);
 void editor_move_cursor(struct editor_state *state, int key);
 int editor_read_key(struct editor_state *state);
+// Whether there are keys left from the last read.
+int editor_input_pending(struct editor_state *state);
+// Waits for keys, for the search to find more or for the status message to be due to go.
+// Returns 0 if it was the last of those, 1 if not.
+int editor_wait_input(struct editor_state *state);
 void editor_process_keypress(struct editor_state *state);
 void editor_open_file(struct editor_state *state, const char *filename);
 void editor_insert_row(struct editor_state *state, char *s, size_t len, size_t at);
-void editor_update_row(struct editor_state *state, e_row *row);
+e_row *editor_row(struct editor_state *state, size_t at);
+void editor_update_row(struct editor_state *state, size_t at);
+void editor_free_row(e_row *row);
 void editor_set_status(struct editor_state *state, const char *fmt, ...);
-char *editor_rows_to_string(struct editor_state *state, int *buf_len);
-void editor_row_append_string(struct editor_state *state, e_row *row, char *s, size_t len);
+void editor_row_append_string(struct editor_state *state, size_t at, char *s, size_t len);
 void editor_delete_row(struct editor_state *state, size_t at);
 char *e_get_prompt_response(struct editor_state *state, const char *prompt, void (*callback)(struct editor_state *, char *, int));
 void editor_delete_char(struct editor_state *state);
 int e_row_cx_to_rx(e_row *row, int cx);
 void editor_insert_char(struct editor_state *state, int c);
+void editor_insert_text(struct editor_state *state, const char *s, size_t len);
 void editor_insert_newline(struct editor_state *state);
 void editor_find_callback(struct editor_state *state, char *query, int key);
-void editor_find(struct editor_state *state);
+void editor_find_regex_callback(struct editor_state *state, char *query, int key);
+void editor_find(struct editor_state *state, int regex);
 
 enum editor_key {
     ARROW_LEFT = 1000,
@@ -56,6 +71,8 @@ enum editor_key {
     HOME,
     END,
     DEL,
+    SEARCH_RESULTS, // not a key: the search has found more, see editor_read_key
+    PASTE_START,    // ESC [ 200 ~: what comes next was pasted, up to ESC [ 201 ~
     BACKSPACE = 127,
 };
 #endif
\ No newline at end of file
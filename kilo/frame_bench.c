@@ -0,0 +1,84 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "editor.h"
+
+/*
+   Times editor_refresh_screen on a rows x cols terminal with the output going to
+   /dev/null, so what is measured is building the frame. Prints CSV:
+
+       frame,rows,cols,frames,us_per_frame,bytes_per_frame
+
+   "page" moves a page down the file every frame, so every row is new; "cursor" moves the
+   cursor along a line, so the text stays put.
+
+   Usage: ./frame_bench [file] [rows] [cols]
+*/
+
+#define BENCH_FRAMES 2000
+
+extern struct editor_syntax HLDB[];
+
+struct editor_state state;
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Refreshes BENCH_FRAMES times, calling step before each frame.
+static void run(const char *name, void (*step)(size_t), int out) {
+    off_t before = lseek(STDOUT_FILENO, 0, SEEK_CUR);
+    double t = now();
+    for (size_t i = 0; i < BENCH_FRAMES; i++) {
+        step(i);
+        editor_refresh_screen(&state);
+    }
+    t = now() - t;
+    off_t bytes = lseek(STDOUT_FILENO, 0, SEEK_CUR) - before;
+    dprintf(out, "%s,%zu,%zu,%d,%.1f,%.0f\n", name, state.rows + STATUSLINE_COUNT, state.cols, BENCH_FRAMES,
+            t * 1e6 / BENCH_FRAMES, (double) bytes / BENCH_FRAMES);
+}
+
+static void page(size_t i) {
+    size_t pages = state.n_rows / state.rows;
+    state.row_offset = (i % (pages ? pages : 1)) * state.rows;
+    state.cy = state.row_offset;
+    state.cx = 0;
+}
+
+static void cursor(size_t i) {
+    state.cy = state.row_offset;
+    state.cx = i % 40;
+}
+
+int main(int argc, char *argv[]) {
+    const char *filename = argc > 1 ? argv[1] : "editor.c";
+    // the output goes to a file so its size can be read back
+    char path[] = "/tmp/frame_benchXXXXXX";
+    int fd = mkstemp(path);
+    int out = dup(STDOUT_FILENO);
+    if (fd == -1 || out == -1 || dup2(fd, STDOUT_FILENO) == -1) {
+        perror("frame_bench");
+        return 1;
+    }
+    unlink(path);
+    if (editor_syntax_compile(&HLDB[0]) != 0) {
+        dprintf(out, "could not compile the syntax\n");
+        return 1;
+    }
+    if (piece_table_init(&state.doc, NULL, 0, NULL, 0) != 0)
+        return 1;
+    editor_open_file(&state, filename);
+    state.rows = (argc > 2 ? strtoul(argv[2], NULL, 10) : 100) - STATUSLINE_COUNT;
+    state.cols = argc > 3 ? strtoul(argv[3], NULL, 10) : 300;
+
+    dprintf(out, "frame,rows,cols,frames,us_per_frame,bytes_per_frame\n");
+    run("page", page, out);
+    run("cursor", cursor, out);
+    return 0;
+}
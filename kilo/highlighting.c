@@ -2,117 +2,84 @@
 #include "highlighting.h"
 #include "structs.h"
 
-void editor_update_syntax(struct editor_state *state, e_row *row) {
-    row->hl = realloc(row->hl, row->render_size);
-    memset(row->hl, HL_NORMAL, row->render_size);
-    if (state->syntax == NULL)
-        return;
-
-    char *scs = state->syntax->singleline_comment_start;
-    char *mcs = state->syntax->multiline_comment_start;
-    char *mce = state->syntax->multiline_comment_end;
-
-    int scs_len = scs ? strlen(scs) : 0;
-    int mcs_len = mcs ? strlen(mcs) : 0;
-    int mce_len = mce ? strlen(mce) : 0;
-    char **keywords = state->syntax->keywords;
+static int line_in_comment(struct editor_state *state, size_t at) {
+    return at > 0 && (state->hl_state[at - 1] & HL_STATE_OUT);
+}
 
-    int prev_sep = 1;
-    int in_string = 0;
-    int in_comment = (row->idx > 0 && state->row[row->idx - 1].hl_open_comment);
-
-    int i = 0;
-    while (i < row->render_size) {
-        char c = row->render[i];
-        unsigned char prev_hl = (i > 0) ? row->hl[i - 1] : HL_NORMAL;
-
-        if (scs_len && !in_string && !in_comment) {
-            if (!strncmp(&row->render[i], scs, scs_len)) {
-                memset(&row->hl[i], HL_COMMENT, row->render_size - i);
-                break;
-            }
-        }
-        if (mcs_len && mce_len && !in_string) {
-            if (in_comment) {
-                row->hl[i] = HL_MLCOMMENT;
-                if (!strncmp(&row->render[i], mce, mce_len)) {
-                    memset(&row->hl[i], HL_MLCOMMENT, mce_len);
-                    i += mce_len;
-                    in_comment = 0;
-                    prev_sep = 1;
-                    continue;
-                }
-                else {
-                    i++;
-                    continue;
-                }
-            }
-            else if (!strncmp(&row->render[i], mcs, mcs_len)) {
-                memset(&row->hl[i], HL_MLCOMMENT, mcs_len);
-                i += mcs_len;
-                in_comment = 1;
-                continue;
-            }
-        }
+// Works out whether an unloaded line ends inside a block comment, from its text in the
+// document, without building its row.
+static int scan_line(struct editor_state *state, size_t at, int in_comment) {
+    static char *text = NULL;
+    static size_t cap = 0;
+    size_t start = piece_table_line_offset(&state->doc, at);
+    size_t len = piece_table_line_offset(&state->doc, at + 1) - start;
+    if (len + 1 > cap) {
+        cap = (len + 1) * 2;
+        free(text);
+        text = malloc(cap);
+        if (text == NULL)
+            die("scan_line", state);
+    }
+    piece_table_read(&state->doc, start, len, text);
+    while (len > 0 && (text[len - 1] == '\n' || text[len - 1] == '\r'))
+        len--;
+    text[len] = '\0';
+    size_t pos = 0;
+    unsigned char mode = in_comment ? LEX_MODE_COMMENT : LEX_MODE_SEP;
+    editor_syntax_lex(state->syntax, text, len, &pos, &mode, len, NULL);
+    return state->syntax && mode == LEX_MODE_COMMENT;
+}
 
-        if (state->syntax->flags & HL_HIGHLIGHT_STRINGS) {
-            if (in_string) {
-                row->hl[i] = HL_STRING;
-                if (c == '\\' && i + 1 < row->render_size) {
-                    row->hl[i + 1] = HL_STRING;
-                    i += 2;
-                    continue;
-                }
-                if (c == in_string)
-                    in_string = 0;
-                i++;
-                prev_sep = 1;
-                continue;
-            }
-            else {
-                if (c == '"' || c == '\'') {
-                    in_string = c;
-                    row->hl[i] = HL_STRING;
-                    i++;
-                    continue;
-                }
-            }
-        }
+// Brings the row's lexer states up to date. What part of it is drawn is highlighted again
+// when it is.
+static int highlight_row(struct editor_state *state, e_row *row, int in_comment) {
+    row->hl_valid = 0;
+    return row_index_lex(&row->index, state->syntax, row->chars, row->size, in_comment);
+}
 
-        if (state->syntax->flags & HL_HIGHLIGHT_NUMBERS) {
-            if ((isdigit(c) && (prev_sep || prev_hl == HL_NUMBER)) || (c == '.' && prev_hl == HL_NUMBER)) {
-                row->hl[i] = HL_NUMBER;
-                i++;
-                prev_sep = 0;
-                continue;
-            }
+void editor_highlight_to(struct editor_state *state, size_t last) {
+    while (state->hl_frontier <= last && state->hl_frontier < state->n_rows) {
+        size_t at = state->hl_frontier;
+        int in_comment = line_in_comment(state, at);
+        unsigned char line = state->hl_state[at];
+        // a line whose text and entry state haven't changed still ends the same way, so
+        // once the states converge the lines below only need this check, not a rescan
+        if (!(line & HL_STATE_VALID) || !(line & HL_STATE_IN) != !in_comment) {
+            int out = state->row[at] ? highlight_row(state, state->row[at], in_comment)
+                                     : scan_line(state, at, in_comment);
+            state->hl_state[at] = HL_STATE_VALID | (in_comment ? HL_STATE_IN : 0) | (out ? HL_STATE_OUT : 0);
         }
+        state->hl_frontier++;
+    }
+}
 
-        if (prev_sep) {
-            size_t j;
-            for (j = 0; keywords[j]; j++) {
-                int klen = strlen(keywords[j]);
-                int kw2 = keywords[j][klen - 1] == '|';
-                if (kw2)
-                    klen--;
-                if (!strncmp(&row->render[i], keywords[j], klen) &&
-                    is_separator(row->render[i + klen])) {
-                    memset(&row->hl[i], kw2 ? HL_KEYWORD2 : HL_KEYWORD1, klen);
-                    i += klen;
-                    break;
-                }
-            }
-            if (keywords[j] != NULL) {
-                prev_sep = 0;
-                continue;
-            }
-        }
+void editor_highlight_row(struct editor_state *state, size_t at, size_t from, size_t to) {
+    editor_highlight_to(state, at);
+    e_row *row = state->row[at];
+    int in_comment = line_in_comment(state, at);
+    if (!row_index_lexed(&row->index, in_comment))
+        highlight_row(state, row, in_comment);
+    if (row->hl_valid && from >= row->hl_from && to <= row->hl_to)
+        return;
+    // from the lexer state kept nearest before from, so a long row costs no more than a short one
+    size_t pos;
+    unsigned char mode;
+    row_index_lex_state(&row->index, from, &pos, &mode);
+    row->hl = realloc(row->hl, to > pos ? to - pos : 1);
+    if (row->hl == NULL)
+        die("realloc", state);
+    row->hl_from = pos;
+    row->hl_to = to;
+    row->hl_valid = 1;
+    editor_syntax_lex(state->syntax, row->chars, row->size, &pos, &mode, to, row->hl);
+}
 
-        prev_sep = is_separator(c);
-        i++;
+void editor_invalidate_highlight(struct editor_state *state, size_t at) {
+    if (at < state->n_rows) {
+        state->hl_state[at] = 0;
+        if (state->row[at])
+            state->row[at]->hl_valid = 0;
     }
-    int changed = (row->hl_open_comment != in_comment);
-    row->hl_open_comment = in_comment;
-    if (changed && row->idx + 1 < state->n_rows)
-        editor_update_syntax(state, &state->row[row->idx + 1]);
-}
\ No newline at end of file
+    if (at < state->hl_frontier)
+        state->hl_frontier = at;
+}
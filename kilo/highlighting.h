@@ -3,11 +3,45 @@
 #define HL_HIGHLIGHT_NUMBERS (1 << 0)
 #define HL_HIGHLIGHT_STRINGS (1 << 1)
 
+#include <stdint.h>
 #include <stdlib.h>
 
 #include "editor.h"
 #include "structs.h"
 
+// Character classes of the lexer. Everything up to LEX_DOT is a separator.
+enum lex_class {
+    LEX_SEP = 0,
+    LEX_DOT,
+    LEX_DIGIT,
+    LEX_DQUOTE,
+    LEX_SQUOTE,
+    LEX_BACKSLASH,
+    LEX_WORD,
+    LEX_CLASSES,
+};
+
+// What the lexer is in the middle of.
+enum lex_mode {
+    LEX_MODE_SEP = 0, // just after a separator, where a keyword or number may start
+    LEX_MODE_WORD,
+    LEX_MODE_NUMBER,
+    LEX_MODE_DQ,
+    LEX_MODE_SQ,
+    LEX_MODE_DQ_ESC,
+    LEX_MODE_SQ_ESC,
+    LEX_MODE_COMMENT,
+    LEX_MODE_LINE_COMMENT, // the rest of the line is a comment
+    LEX_MODES,
+};
+
+#define LEX_DELIM_SCS (1 << 0) // the byte starts singleline_comment_start
+#define LEX_DELIM_MCS (1 << 1)
+#define LEX_DELIM_MCE (1 << 2)
+#define LEX_TRY_KEYWORD 0xff   // lex_hl entry: look the word up in the keyword trie
+#define LEX_KW_DEAD 0
+#define LEX_KW_ROOT 1
+
 struct editor_syntax {
     char *filetype;
     char **filematch;
@@ -16,6 +50,21 @@ struct editor_syntax {
     char *multiline_comment_start;
     char *multiline_comment_end;
     int flags;
+    // filled in by editor_syntax_compile: the lexer's tables, indexed by mode and the
+    // class of the next byte, and the keywords as a trie over kw_class
+    int compiled;
+    int scs_len;
+    int mcs_len;
+    int mce_len;
+    int lookahead; // most bytes past where the lexer is that it reads to take a step, see row_index_lex
+    unsigned char char_class[256];
+    unsigned char delim_start[256];
+    unsigned char lex_hl[LEX_MODES][LEX_CLASSES];
+    unsigned char lex_next[LEX_MODES][LEX_CLASSES];
+    unsigned char kw_class[256];
+    int kw_classes;
+    uint16_t *kw_next; // kw_classes entries per node
+    unsigned char *kw_hl; // HL_KEYWORD1 / HL_KEYWORD2 if a keyword ends at the node
 };
 
 #define HLDB_ENTRIES (sizeof(HLDB) / sizeof(HLDB[0]))
@@ -32,6 +81,33 @@ enum editor_highlights
     HL_MLCOMMENT,
 };
 
-void editor_update_syntax(struct editor_state *state, e_row *row);
+#define HL_STATE_VALID (1 << 0) // the line hasn't changed since its state was worked out
+#define HL_STATE_IN (1 << 1)    // it starts inside a block comment
+#define HL_STATE_OUT (1 << 2)   // it ends inside one
+
+// Works out the block comment state of every line up to last, from the first line whose
+// state might be out of date (state->hl_frontier). Loaded rows get highlighted on the way,
+// unloaded lines are only scanned.
+void editor_highlight_to(struct editor_state *state, size_t last);
+
+// Makes sure row at (which has to be loaded) has an up to date hl for chars[from..to).
+void editor_highlight_row(struct editor_state *state, size_t at, size_t from, size_t to);
+
+// Marks line at as changed, so it and the lines after it are looked at again.
+void editor_invalidate_highlight(struct editor_state *state, size_t at);
+
+// Builds syntax's lexer tables. Returns -1 if malloc fails.
+int editor_syntax_compile(struct editor_syntax *syntax);
+
+// Highlights text[0..len) into hl with a compiled syntax (or none). in_comment says whether
+// the text starts inside a block comment; returns whether it ends inside one.
+int editor_syntax_highlight(const struct editor_syntax *syntax, const char *text, int len, unsigned char *hl, int in_comment);
+
+// Lexes text[0..len) from byte *pos, with the lexer in *mode there, until it gets to stop
+// (or just past it, in the middle of a keyword or delimiter), and leaves *pos and *mode
+// where it got to. hl, if not NULL, gets the highlight of every byte from *pos up to stop.
+void editor_syntax_lex(const struct editor_syntax *syntax, const char *text, size_t len, size_t *pos,
+                       unsigned char *mode, size_t stop, unsigned char *hl);
+
 int is_separator(int c);
 #endif
\ No newline at end of file
@@ -0,0 +1,212 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "editor.h"
+#include "highlighting.h"
+
+/*
+   Highlights BENCH_INPUT_SIZE of C, made by repeating the given files (kilo's own sources
+   by default), line by line the way the editor does, once with the branchy highlighter
+   kilo used to have and once with the compiled lexer. Checks that both give the same hl
+   for every byte and prints CSV:
+
+       highlighter,bytes,seconds,mb_per_s
+
+   Usage: ./hl_bench [input_mb] [file...]
+*/
+
+#define BENCH_INPUT_SIZE (64UL * 1024 * 1024)
+
+char *C_HL_extensions[] = {".c", ".h", ".cpp", NULL};
+char *C_HL_keywords[] = {
+    "switch", "if", "while", "for", "break", "continue", "return", "else",
+    "struct", "union", "typedef", "static", "enum", "class", "case",
+    "int|", "long|", "double|", "float|", "char|", "unsigned|", "signed|",
+    "void|", NULL};
+
+struct editor_syntax HLDB[] = {
+    {.filetype = "c",
+     .filematch = C_HL_extensions,
+     .keywords = C_HL_keywords,
+     .singleline_comment_start = "//",
+     .multiline_comment_start = "/*",
+     .multiline_comment_end = "*/",
+     .flags = HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS}};
+
+static const char *default_files[] = {"editor.c", "highlighting.c", "piece_table.c", "../LMC/line_index.c", "termutils.c", "kilo.c", "lexer.c"};
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// kilo's highlighter before the lexer: every byte goes through the comment, string and
+// number checks, and every word start through strncmp against each keyword.
+static int reference_highlight(const struct editor_syntax *syntax, const char *text, int len, unsigned char *hl, int in_comment) {
+    memset(hl, HL_NORMAL, len);
+    char **keywords = syntax->keywords;
+    char *scs = syntax->singleline_comment_start;
+    char *mcs = syntax->multiline_comment_start;
+    char *mce = syntax->multiline_comment_end;
+    int scs_len = scs ? strlen(scs) : 0;
+    int mcs_len = mcs ? strlen(mcs) : 0;
+    int mce_len = mce ? strlen(mce) : 0;
+    int prev_sep = 1;
+    int in_string = 0;
+    int i = 0;
+    while (i < len) {
+        char c = text[i];
+        unsigned char prev_hl = (i > 0) ? hl[i - 1] : HL_NORMAL;
+        if (scs_len && !in_string && !in_comment) {
+            if (!strncmp(&text[i], scs, scs_len)) {
+                memset(&hl[i], HL_COMMENT, len - i);
+                break;
+            }
+        }
+        if (mcs_len && mce_len && !in_string) {
+            if (in_comment) {
+                hl[i] = HL_MLCOMMENT;
+                if (!strncmp(&text[i], mce, mce_len)) {
+                    memset(&hl[i], HL_MLCOMMENT, mce_len);
+                    i += mce_len;
+                    in_comment = 0;
+                    prev_sep = 1;
+                    continue;
+                }
+                i++;
+                continue;
+            }
+            else if (!strncmp(&text[i], mcs, mcs_len)) {
+                memset(&hl[i], HL_MLCOMMENT, mcs_len);
+                i += mcs_len;
+                in_comment = 1;
+                continue;
+            }
+        }
+        if (syntax->flags & HL_HIGHLIGHT_STRINGS) {
+            if (in_string) {
+                hl[i] = HL_STRING;
+                if (c == '\\' && i + 1 < len) {
+                    hl[i + 1] = HL_STRING;
+                    i += 2;
+                    continue;
+                }
+                if (c == in_string)
+                    in_string = 0;
+                i++;
+                prev_sep = 1;
+                continue;
+            }
+            else if (c == '"' || c == '\'') {
+                in_string = c;
+                hl[i] = HL_STRING;
+                i++;
+                continue;
+            }
+        }
+        if (syntax->flags & HL_HIGHLIGHT_NUMBERS) {
+            if ((isdigit(c) && (prev_sep || prev_hl == HL_NUMBER)) || (c == '.' && prev_hl == HL_NUMBER)) {
+                hl[i] = HL_NUMBER;
+                i++;
+                prev_sep = 0;
+                continue;
+            }
+        }
+        if (prev_sep) {
+            int j;
+            for (j = 0; keywords[j]; j++) {
+                int klen = strlen(keywords[j]);
+                int kw2 = keywords[j][klen - 1] == '|';
+                if (kw2) klen--;
+                if (!strncmp(&text[i], keywords[j], klen) && is_separator(text[i + klen])) {
+                    memset(&hl[i], kw2 ? HL_KEYWORD2 : HL_KEYWORD1, klen);
+                    i += klen;
+                    break;
+                }
+            }
+            if (keywords[j] != NULL) {
+                prev_sep = 0;
+                continue;
+            }
+        }
+        prev_sep = is_separator(c);
+        i++;
+    }
+    return in_comment;
+}
+
+typedef int (*highlighter)(const struct editor_syntax *, const char *, int, unsigned char *, int);
+
+// Highlights every line of input (each one null terminated in place) into hl.
+static double run(highlighter highlight, char *input, size_t size, unsigned char *hl) {
+    double t = now();
+    int in_comment = 0;
+    size_t start = 0;
+    while (start < size) {
+        char *nl = memchr(&input[start], '\0', size - start);
+        size_t len = nl ? (size_t) (nl - &input[start]) : size - start;
+        in_comment = highlight(&HLDB[0], &input[start], len, &hl[start], in_comment);
+        start += len + 1;
+    }
+    return now() - t;
+}
+
+int main(int argc, char *argv[]) {
+    size_t size = argc > 1 ? strtoull(argv[1], NULL, 10) * 1024 * 1024 : BENCH_INPUT_SIZE;
+    const char **files = argc > 2 ? (const char **) &argv[2] : default_files;
+    int n_files = argc > 2 ? argc - 2 : (int) (sizeof(default_files) / sizeof(default_files[0]));
+
+    char *input = malloc(size + 1);
+    unsigned char *ref_hl = malloc(size + 1);
+    unsigned char *lex_hl = malloc(size + 1);
+    if (input == NULL || ref_hl == NULL || lex_hl == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    size_t filled = 0;
+    while (filled < size) {
+        size_t before = filled;
+        for (int f = 0; f < n_files && filled < size; f++) {
+            FILE *fp = fopen(files[f], "r");
+            if (fp == NULL)
+                continue;
+            filled += fread(&input[filled], 1, size - filled, fp);
+            fclose(fp);
+        }
+        if (filled == before) {
+            fprintf(stderr, "could not read any input\n");
+            return 1;
+        }
+    }
+    // lines are highlighted in place, like the editor's null terminated renders
+    for (size_t i = 0; i < size; i++) {
+        if (input[i] == '\n') input[i] = '\0';
+    }
+    input[size] = '\0';
+    if (editor_syntax_compile(&HLDB[0]) != 0) {
+        fprintf(stderr, "could not compile the syntax\n");
+        return 1;
+    }
+
+    printf("highlighter,bytes,seconds,mb_per_s\n");
+    double t = run(reference_highlight, input, size, ref_hl);
+    printf("branchy,%zu,%.4f,%.1f\n", size, t, size / t / 1e6);
+    t = run(editor_syntax_highlight, input, size, lex_hl);
+    printf("lexer,%zu,%.4f,%.1f\n", size, t, size / t / 1e6);
+
+    for (size_t i = 0; i < size; i++) {
+        if (input[i] != '\0' && ref_hl[i] != lex_hl[i]) {
+            fprintf(stderr, "hl differs at byte %zu: %d vs %d\n", i, ref_hl[i], lex_hl[i]);
+            return 1;
+        }
+    }
+    fprintf(stderr, "hl identical for all %zu bytes\n", size);
+    free(input);
+    free(ref_hl);
+    free(lex_hl);
+    return 0;
+}
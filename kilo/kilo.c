@@ -9,10 +9,16 @@ int main(int argc, char* argv[]) {
     if (argc >= 2) {
         editor_open_file(&state, argv[1]);
     }
-    editor_set_status(&state, "Help: C-q to quit, C-s to save, C-S to save and quit");
+    editor_set_status(&state, "Help: C-q to quit, C-s to save, C-S to save and quit, C-z/C-y undo/redo");
     while (1) {
         editor_refresh_screen(&state);
-        editor_process_keypress(&state);
+        // nothing is drawn again until something changes, and then not until all the keys
+        // that came in together have been handled
+        if (!editor_wait_input(&state))
+            continue;
+        do {
+            editor_process_keypress(&state);
+        } while (editor_input_pending(&state));
     }
     disable_raw_mode(&state);
     return 0;
@@ -0,0 +1,743 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "kilo_regex.h"
+
+// Parsed pattern, a tree of nodes in an array; only needed until the progs are built.
+enum {
+    NODE_SET = REGEX_SET,
+    NODE_LINE_BEGIN = REGEX_LINE_BEGIN,
+    NODE_LINE_END = REGEX_LINE_END,
+    NODE_EMPTY = REGEX_MATCH + 1,
+    NODE_CAT,
+    NODE_ALT,
+    NODE_STAR,
+    NODE_PLUS,
+    NODE_QUEST,
+};
+
+struct node {
+    unsigned char type;
+    int left;
+    int right;
+    int set;
+};
+
+struct parser {
+    const char *p;
+    struct regex *re;
+    struct node *nodes;
+    int n_nodes;
+    int cap;
+    int depth;
+};
+
+static int new_node(struct parser *ps, int type, int left, int right, int set) {
+    if (ps->n_nodes == ps->cap) {
+        int cap = ps->cap ? ps->cap * 2 : 64;
+        struct node *nodes = realloc(ps->nodes, cap * sizeof(struct node));
+        if (nodes == NULL)
+            return -1;
+        ps->nodes = nodes;
+        ps->cap = cap;
+    }
+    ps->nodes[ps->n_nodes] = (struct node) { type, left, right, set };
+    return ps->n_nodes++;
+}
+
+// A new empty byte set, or -1 if malloc fails.
+static int new_set(struct regex *re) {
+    unsigned char (*sets)[32] = realloc(re->sets, (re->n_sets + 1) * sizeof(*sets));
+    if (sets == NULL)
+        return -1;
+    re->sets = sets;
+    memset(sets[re->n_sets], 0, 32);
+    return re->n_sets++;
+}
+
+static void set_add(unsigned char *set, int from, int to) {
+    for (int c = from; c <= to; c++) set[c >> 3] |= 1 << (c & 7);
+}
+
+static int set_has(const unsigned char *set, int c) {
+    return set[c >> 3] & (1 << (c & 7));
+}
+
+// Inverts set, leaving out the newline that no match may take in.
+static void set_invert(unsigned char *set) {
+    for (int i = 0; i < 32; i++) set[i] = ~set[i];
+    set['\n' >> 3] &= ~(1 << ('\n' & 7));
+}
+
+// Adds \d, \w or \s (or their inverses) to set; returns 0 if c isn't one of them.
+static int set_add_escape(unsigned char *set, char c) {
+    unsigned char class[32] = { 0 };
+    switch (c | 0x20) {
+    case 'd':
+        set_add(class, '0', '9');
+        break;
+    case 'w':
+        set_add(class, '0', '9');
+        set_add(class, 'a', 'z');
+        set_add(class, 'A', 'Z');
+        set_add(class, '_', '_');
+        break;
+    case 's':
+        set_add(class, ' ', ' ');
+        set_add(class, '\t', '\t');
+        set_add(class, '\v', '\r');
+        set_add(class, '\n', '\n');
+        break;
+    default:
+        return 0;
+    }
+    if (c >= 'A' && c <= 'Z')
+        set_invert(class);
+    class['\n' >> 3] &= ~(1 << ('\n' & 7));
+    for (int i = 0; i < 32; i++) set[i] |= class[i];
+    return 1;
+}
+
+static int parse_alt(struct parser *ps);
+
+// [...] with ps->p just past the '['.
+static int parse_class(struct parser *ps) {
+    int set = new_set(ps->re);
+    if (set < 0)
+        return -1;
+    int negate = *ps->p == '^';
+    if (negate)
+        ps->p++;
+    int first = 1;
+    while (*ps->p != ']' || first) {
+        unsigned char c = *ps->p++;
+        if (c == '\0')
+            return -1;
+        first = 0;
+        if (c == '\\') {
+            if (*ps->p == '\0')
+                return -1;
+            c = *ps->p++;
+            if (set_add_escape(ps->re->sets[set], c))
+                continue;
+        }
+        unsigned char to = c;
+        if (ps->p[0] == '-' && ps->p[1] != ']' && ps->p[1] != '\0') {
+            to = ps->p[1];
+            if (to == '\\' && ps->p[2] != '\0') {
+                to = ps->p[2];
+                ps->p++;
+            }
+            ps->p += 2;
+            if (to < c)
+                return -1;
+        }
+        set_add(ps->re->sets[set], c, to);
+    }
+    ps->p++;
+    if (negate)
+        set_invert(ps->re->sets[set]);
+    ps->re->sets[set]['\n' >> 3] &= ~(1 << ('\n' & 7));
+    return new_node(ps, NODE_SET, -1, -1, set);
+}
+
+static int parse_atom(struct parser *ps) {
+    unsigned char c = *ps->p++;
+    int set;
+    switch (c) {
+    case '(': {
+        if (++ps->depth > REGEX_MAX_DEPTH)
+            return -1;
+        int node = parse_alt(ps);
+        if (node < 0 || *ps->p != ')')
+            return -1;
+        ps->p++;
+        ps->depth--;
+        return node;
+    }
+    case '[':
+        return parse_class(ps);
+    case '^':
+        return new_node(ps, NODE_LINE_BEGIN, -1, -1, -1);
+    case '$':
+        return new_node(ps, NODE_LINE_END, -1, -1, -1);
+    case '.':
+        if ((set = new_set(ps->re)) < 0)
+            return -1;
+        set_invert(ps->re->sets[set]);
+        return new_node(ps, NODE_SET, -1, -1, set);
+    case '*':
+    case '+':
+    case '?':
+    case ')':
+    case '|':
+    case '\0':
+        return -1;
+    case '\\':
+        if ((c = *ps->p++) == '\0')
+            return -1;
+        if ((set = new_set(ps->re)) < 0)
+            return -1;
+        if (!set_add_escape(ps->re->sets[set], c))
+            set_add(ps->re->sets[set], c, c);
+        return new_node(ps, NODE_SET, -1, -1, set);
+    default:
+        if ((set = new_set(ps->re)) < 0)
+            return -1;
+        set_add(ps->re->sets[set], c, c);
+        return new_node(ps, NODE_SET, -1, -1, set);
+    }
+}
+
+static int parse_repeat(struct parser *ps) {
+    int node = parse_atom(ps);
+    while (node >= 0 && (*ps->p == '*' || *ps->p == '+' || *ps->p == '?')) {
+        int type = *ps->p == '*' ? NODE_STAR : *ps->p == '+' ? NODE_PLUS : NODE_QUEST;
+        ps->p++;
+        // a repeat of a repeat is * unless both are + or both ?, so they never stack up
+        int inner = ps->nodes[node].type;
+        if (inner == NODE_STAR || inner == NODE_PLUS || inner == NODE_QUEST)
+            ps->nodes[node].type = inner == type ? type : NODE_STAR;
+        else
+            node = new_node(ps, type, node, -1, -1);
+    }
+    return node;
+}
+
+static int parse_concat(struct parser *ps) {
+    int node = new_node(ps, NODE_EMPTY, -1, -1, -1);
+    while (node >= 0 && *ps->p != '\0' && *ps->p != '|' && *ps->p != ')') {
+        int right = parse_repeat(ps);
+        if (right < 0)
+            return -1;
+        node = ps->nodes[node].type == NODE_EMPTY ? right : new_node(ps, NODE_CAT, node, right, -1);
+    }
+    return node;
+}
+
+static int parse_alt(struct parser *ps) {
+    int node = parse_concat(ps);
+    while (node >= 0 && *ps->p == '|') {
+        ps->p++;
+        int right = parse_concat(ps);
+        if (right < 0)
+            return -1;
+        node = new_node(ps, NODE_ALT, node, right, -1);
+    }
+    return node;
+}
+
+static int new_inst(struct regex_prog *prog, int op, int set, int out, int out1) {
+    if (prog->n == prog->cap) {
+        int cap = prog->cap ? prog->cap * 2 : 64;
+        struct regex_inst *insts = realloc(prog->insts, cap * sizeof(struct regex_inst));
+        if (insts == NULL)
+            return -1;
+        prog->insts = insts;
+        prog->cap = cap;
+    }
+    prog->insts[prog->n] = (struct regex_inst) { op, set, out, out1 };
+    return prog->n++;
+}
+
+// The nodes joined by type at node, left to right, into parts, nodes of that type below
+// them taken apart too; returns how many. The parser nests concatenations and alternations
+// to the left as deep as the pattern is long, so this keeps its own stack, which like parts
+// needs room for every node, rather than recursing.
+static int chain_parts(const struct node *nodes, int node, int type, int *parts, int *stack) {
+    int n = 0, top = 0;
+    stack[top++] = node;
+    while (top > 0) {
+        node = stack[--top];
+        if (nodes[node].type == type) {
+            stack[top++] = nodes[node].right;
+            stack[top++] = nodes[node].left;
+        }
+        else {
+            parts[n++] = node;
+        }
+    }
+    return n;
+}
+
+// Builds the instructions for node, which go on to next, and returns the first. A reversed
+// prog reads concatenations right to left, for matching backwards from a match's end.
+static int compile_node(struct regex_prog *prog, const struct node *nodes, int n_nodes, int node, int next, int reverse) {
+    const struct node *n = &nodes[node];
+    int split, first, count, *parts;
+    switch (n->type) {
+    case NODE_SET:
+        return new_inst(prog, REGEX_SET, n->set, next, -1);
+    case NODE_LINE_BEGIN:
+    case NODE_LINE_END:
+        return new_inst(prog, n->type, -1, next, -1);
+    case NODE_EMPTY:
+        return next;
+    case NODE_CAT:
+    case NODE_ALT:
+        if ((parts = malloc(2 * n_nodes * sizeof(int))) == NULL)
+            return -1;
+        count = chain_parts(nodes, node, n->type, parts, &parts[n_nodes]);
+        first = next;
+        for (int i = 0; i < count && first >= 0; i++) {
+            if (n->type == NODE_ALT) {
+                int alt = compile_node(prog, nodes, n_nodes, parts[i], next, reverse);
+                first = alt < 0 ? -1 : i == 0 ? alt : new_inst(prog, REGEX_SPLIT, -1, first, alt);
+            }
+            else {
+                first = compile_node(prog, nodes, n_nodes, parts[reverse ? i : count - 1 - i], first, reverse);
+            }
+        }
+        free(parts);
+        return first;
+    case NODE_QUEST:
+        if ((first = compile_node(prog, nodes, n_nodes, n->left, next, reverse)) < 0)
+            return -1;
+        return new_inst(prog, REGEX_SPLIT, -1, first, next);
+    case NODE_STAR:
+    case NODE_PLUS:
+        // the loop's split is made first so that the body can go back to it
+        if ((split = new_inst(prog, REGEX_SPLIT, -1, -1, next)) < 0 ||
+            (first = compile_node(prog, nodes, n_nodes, n->left, split, reverse)) < 0)
+            return -1;
+        prog->insts[split].out = first;
+        return n->type == NODE_STAR ? split : first;
+    }
+    return -1;
+}
+
+static int compile_prog(struct regex_prog *prog, const struct node *nodes, int n_nodes, int root, int reverse) {
+    int match = new_inst(prog, REGEX_MATCH, -1, -1, -1);
+    if (match < 0)
+        return -1;
+    prog->start = compile_node(prog, nodes, n_nodes, root, match, reverse);
+    return prog->start < 0 ? -1 : 0;
+}
+
+// The one byte set takes, or -1 if it takes more or none.
+static int set_byte(const unsigned char *set) {
+    int byte = -1;
+    for (int c = 0; c < 256; c++) {
+        if (set_has(set, c)) {
+            if (byte >= 0)
+                return -1;
+            byte = c;
+        }
+    }
+    return byte;
+}
+
+// Finds the longest run of bytes that every match has one after the other, from the
+// concatenation at the top of the pattern: single bytes, and the first of a repeated one.
+static int find_literal(struct regex *re, const struct node *nodes, int n_nodes, int root) {
+    int *parts = malloc(2 * n_nodes * sizeof(int));
+    if (parts == NULL)
+        return -1;
+    int n = chain_parts(nodes, root, NODE_CAT, parts, &parts[n_nodes]);
+    char run[REGEX_LITERAL_MAX];
+    size_t run_len = 0;
+    for (int i = 0; i <= n; i++) {
+        int byte = -1, ends = 1;
+        if (i < n && nodes[parts[i]].type == NODE_SET) {
+            byte = set_byte(re->sets[nodes[parts[i]].set]);
+            ends = 0;
+        }
+        else if (i < n && nodes[parts[i]].type == NODE_PLUS && nodes[nodes[parts[i]].left].type == NODE_SET) {
+            byte = set_byte(re->sets[nodes[nodes[parts[i]].left].set]);
+        }
+        if (byte >= 0 && run_len < REGEX_LITERAL_MAX)
+            run[run_len++] = byte;
+        else
+            ends = 1;
+        if (ends || byte < 0) {
+            if (run_len > re->literal_len) {
+                memcpy(re->literal, run, run_len);
+                re->literal_len = run_len;
+            }
+            run_len = 0;
+        }
+    }
+    free(parts);
+    return 0;
+}
+
+// Splits the bytes into classes that every set either takes all of or none of, with the
+// newline in a class of its own, so that DFA rows need a column per class, not per byte.
+static void compute_classes(struct regex *re) {
+    memset(re->byte_class, 0, sizeof(re->byte_class));
+    int n = 1;
+    for (int s = -1; s < re->n_sets; s++) {
+        int remap[512];
+        memset(remap, -1, sizeof(remap));
+        int classes = 0;
+        for (int c = 0; c < 256; c++) {
+            int in = s < 0 ? c == '\n' : set_has(re->sets[s], c) != 0;
+            int key = re->byte_class[c] * 2 + in;
+            if (remap[key] < 0)
+                remap[key] = classes++;
+            re->byte_class[c] = remap[key];
+        }
+        n = classes;
+    }
+    re->n_classes = n;
+    for (int c = 255; c >= 0; c--) re->class_byte[re->byte_class[c]] = c;
+}
+
+// The NFA states reached from seeds[0..n) without reading a byte, written to out: byte
+// sets, the match, and end assertions that may still hold later. Assertion pass holds here.
+// Returns how many there are.
+static int closure(struct regex *re, const struct regex_dfa *dfa, const int *seeds, int n, int pass, int *out) {
+    const struct regex_inst *insts = dfa->prog->insts;
+    int *stack = re->work;
+    int top = 0, count = 0;
+    re->gen++;
+    for (int i = n - 1; i >= 0; i--) stack[top++] = seeds[i];
+    while (top) {
+        int s = stack[--top];
+        if (re->mark[s] == re->gen)
+            continue;
+        re->mark[s] = re->gen;
+        const struct regex_inst *inst = &insts[s];
+        switch (inst->op) {
+        case REGEX_SPLIT:
+            stack[top++] = inst->out1;
+            stack[top++] = inst->out;
+            break;
+        case REGEX_LINE_BEGIN:
+        case REGEX_LINE_END:
+            if (inst->op == pass)
+                stack[top++] = inst->out;
+            else if (inst->op == dfa->end)
+                out[count++] = s;
+            break;
+        default:
+            out[count++] = s;
+        }
+    }
+    return count;
+}
+
+// A built transition is stored as the next state, or as -2 - the next state if a match ends
+// there, so that going along text only has to look at the state when there is something to
+// do; -1 is one not built yet.
+#define NEXT_ENCODE(to, flags) ((flags) & REGEX_ACCEPT ? -2 - (to) : (to))
+#define NEXT_STATE(next) ((next) < -1 ? -2 - (next) : (next))
+
+static int cmp_int(const void *a, const void *b) {
+    return *(const int *) a - *(const int *) b;
+}
+
+static unsigned hash_set(const int *set, int n, unsigned char flags) {
+    unsigned h = 2166136261u ^ flags;
+    for (int i = 0; i < n; i++) h = (h ^ (unsigned) set[i]) * 16777619u;
+    return h;
+}
+
+static void dfa_table_insert(struct regex_dfa *dfa, int state) {
+    const struct regex_dstate *d = &dfa->states[state];
+    unsigned slot = hash_set(&dfa->sets[d->set], d->n, d->flags) & (REGEX_DFA_TABLE - 1);
+    while (dfa->table[slot]) slot = (slot + 1) & (REGEX_DFA_TABLE - 1);
+    dfa->table[slot] = state + 1;
+}
+
+// Throws away every state but the first three, which keeps the cache's size bounded
+// whatever the pattern; the states thrown away are built again if they're needed.
+static void dfa_flush(struct regex_dfa *dfa, int n_classes) {
+    dfa->n_states = 3;
+    dfa->sets_len = 0;
+    for (int s = 0; s < 3; s++) {
+        if (dfa->states[s].set + dfa->states[s].n > dfa->sets_len)
+            dfa->sets_len = dfa->states[s].set + dfa->states[s].n;
+    }
+    dfa->flushes++;
+    memset(dfa->table, 0, REGEX_DFA_TABLE * sizeof(int));
+    for (int s = 0; s < 3; s++) dfa_table_insert(dfa, s);
+    for (int i = 0; i < 3 * n_classes; i++) {
+        if (NEXT_STATE(dfa->next[i]) > 2)
+            dfa->next[i] = -1;
+    }
+}
+
+// The state for the NFA states set[0..n) (sorted here) with flags, made if it isn't
+// known. Returns -1 if malloc fails.
+static int dfa_add(struct regex *re, struct regex_dfa *dfa, int *set, int n, unsigned char flags) {
+    qsort(set, n, sizeof(int), cmp_int);
+    unsigned slot = hash_set(set, n, flags) & (REGEX_DFA_TABLE - 1);
+    for (int s; (s = dfa->table[slot]); slot = (slot + 1) & (REGEX_DFA_TABLE - 1)) {
+        const struct regex_dstate *d = &dfa->states[s - 1];
+        if (d->flags == flags && d->n == n && memcmp(&dfa->sets[d->set], set, n * sizeof(int)) == 0)
+            return s - 1;
+    }
+    if (dfa->n_states == REGEX_DFA_MAX_STATES)
+        dfa_flush(dfa, re->n_classes);
+    if (dfa->n_states == dfa->states_cap) {
+        int cap = dfa->states_cap ? dfa->states_cap * 2 : 64;
+        struct regex_dstate *states = realloc(dfa->states, cap * sizeof(struct regex_dstate));
+        if (states == NULL)
+            return -1;
+        dfa->states = states;
+        int *next = realloc(dfa->next, (size_t) cap * re->n_classes * sizeof(int));
+        if (next == NULL)
+            return -1;
+        dfa->next = next;
+        dfa->states_cap = cap;
+    }
+    if (dfa->sets_len + n >= dfa->sets_cap) {
+        size_t cap = dfa->sets_cap ? dfa->sets_cap * 2 : 1024;
+        while (cap < dfa->sets_len + n) cap *= 2;
+        int *sets = realloc(dfa->sets, cap * sizeof(int));
+        if (sets == NULL)
+            return -1;
+        dfa->sets = sets;
+        dfa->sets_cap = cap;
+    }
+    int state = dfa->n_states++;
+    memcpy(&dfa->sets[dfa->sets_len], set, n * sizeof(int));
+    dfa->states[state] = (struct regex_dstate) { dfa->sets_len, n, flags };
+    dfa->sets_len += n;
+    memset(&dfa->next[(size_t) state * re->n_classes], 0xff, re->n_classes * sizeof(int));
+    dfa_table_insert(dfa, state);
+    return state;
+}
+
+// The state after reading a byte of class c in state, built and remembered the first
+// time it's needed. Returns -1 if malloc fails.
+static int dfa_step(struct regex *re, struct regex_dfa *dfa, int state, int c) {
+    int next = dfa->next[(size_t) state * re->n_classes + c];
+    if (next != -1)
+        return NEXT_STATE(next);
+    const struct regex_inst *insts = dfa->prog->insts;
+    int size = dfa->prog->n;
+    int *seeds = &re->work[3 * size];
+    int *moved = &re->work[4 * size];
+    int *ends = &re->work[5 * size];
+    unsigned char byte = re->class_byte[c];
+    const struct regex_dstate *d = &dfa->states[state];
+    int n_seeds = 0;
+    for (int i = 0; i < d->n; i++) {
+        const struct regex_inst *inst = &insts[dfa->sets[d->set + i]];
+        if (inst->op == REGEX_SET && set_has(re->sets[inst->set], byte))
+            seeds[n_seeds++] = inst->out;
+    }
+    int n = closure(re, dfa, seeds, n_seeds, 0, moved);
+    unsigned char flags = 0;
+    int n_ends = 0;
+    for (int i = 0; i < n; i++) {
+        if (insts[moved[i]].op == REGEX_MATCH)
+            flags |= REGEX_ACCEPT | REGEX_ACCEPT_END;
+        else if (insts[moved[i]].op == dfa->end)
+            ends[n_ends++] = insts[moved[i]].out;
+    }
+    if (!(flags & REGEX_ACCEPT_END) && n_ends) {
+        // whether the assertions waiting for the end of the line lead to the match
+        int *reached = seeds;
+        int m = closure(re, dfa, ends, n_ends, dfa->end, reached);
+        for (int i = 0; i < m; i++) {
+            if (insts[reached[i]].op == REGEX_MATCH)
+                flags |= REGEX_ACCEPT_END;
+        }
+    }
+    if (dfa->unanchored) {
+        // a match may also start after this byte; those threads are the middle start's,
+        // added after the flags so that they don't count as empty matches
+        re->gen++;
+        for (int i = 0; i < n; i++) re->mark[moved[i]] = re->gen;
+        const struct regex_dstate *mid = &dfa->states[2];
+        for (int i = 0; i < mid->n; i++) {
+            int s = dfa->sets[mid->set + i];
+            if (re->mark[s] != re->gen)
+                moved[n++] = s;
+        }
+    }
+    unsigned flushes = dfa->flushes;
+    int to = dfa_add(re, dfa, moved, n, flags);
+    if (to < 0)
+        return -1;
+    // if the cache was thrown away only the first three states are still what they were
+    if (flushes == dfa->flushes || state < 3)
+        dfa->next[(size_t) state * re->n_classes + c] = NEXT_ENCODE(to, flags);
+    return to;
+}
+
+static int dfa_init(struct regex *re, struct regex_dfa *dfa, const struct regex_prog *prog, int unanchored, int begin) {
+    dfa->prog = prog;
+    dfa->unanchored = unanchored;
+    dfa->begin = begin;
+    dfa->end = begin == REGEX_LINE_BEGIN ? REGEX_LINE_END : REGEX_LINE_BEGIN;
+    dfa->table = calloc(REGEX_DFA_TABLE, sizeof(int));
+    if (dfa->table == NULL)
+        return -1;
+    int *set = &re->work[4 * prog->n];
+    int start = prog->start;
+    // dead, then the starts at a line boundary and in the middle of a line
+    if (dfa_add(re, dfa, set, 0, 0) != 0)
+        return -1;
+    for (int pass = dfa->begin, want = 1; want <= 2; pass = 0, want++) {
+        int n = closure(re, dfa, &start, 1, pass, set);
+        int state = dfa_add(re, dfa, set, n, 0);
+        if (state < 0)
+            return -1;
+        if (state != want) {
+            // the same set as an earlier state; a copy keeps the numbers fixed
+            dfa->states[want] = dfa->states[state];
+            memset(&dfa->next[want * (size_t) re->n_classes], 0xff, re->n_classes * sizeof(int));
+            dfa->n_states = want + 1;
+        }
+    }
+    // the dead state stays dead, but for a newline, which regex_scan deals with itself
+    for (int c = 0; c < re->n_classes; c++) dfa->next[c] = c == re->byte_class['\n'] ? -1 : 0;
+    return 0;
+}
+
+int regex_compile(struct regex *re, const char *pattern) {
+    memset(re, 0, sizeof(*re));
+    struct parser ps = { pattern, re, NULL, 0, 0, 0 };
+    int root = parse_alt(&ps);
+    if (root < 0 || *ps.p != '\0' ||
+        compile_prog(&re->forward, ps.nodes, ps.n_nodes, root, 0) != 0 ||
+        compile_prog(&re->reverse, ps.nodes, ps.n_nodes, root, 1) != 0 ||
+        find_literal(re, ps.nodes, ps.n_nodes, root) != 0) {
+        free(ps.nodes);
+        regex_free(re);
+        return -1;
+    }
+    free(ps.nodes);
+    compute_classes(re);
+    int size = re->forward.n > re->reverse.n ? re->forward.n : re->reverse.n;
+    // the closure's stack takes up to 3 entries per state; then seeds, moved and ends
+    re->work = malloc(6 * size * sizeof(int));
+    re->mark = calloc(size, sizeof(unsigned));
+    if (re->work == NULL || re->mark == NULL ||
+        dfa_init(re, &re->scan, &re->forward, 1, REGEX_LINE_BEGIN) != 0 ||
+        dfa_init(re, &re->starts, &re->reverse, 1, REGEX_LINE_END) != 0 ||
+        dfa_init(re, &re->longest, &re->forward, 0, REGEX_LINE_BEGIN) != 0) {
+        regex_free(re);
+        return -1;
+    }
+    return 0;
+}
+
+int regex_scan(struct regex *re, int *state, const char *text, size_t len, size_t *used) {
+    struct regex_dfa *dfa = &re->scan;
+    const unsigned char *s = (const unsigned char *) text;
+    unsigned char newline = re->byte_class['\n'];
+    int n_classes = re->n_classes;
+    const int *next = dfa->next;
+    int st = *state;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = re->byte_class[s[i]];
+        int to = next[(size_t) st * n_classes + c];
+        if (to >= 0) {
+            st = to;
+            continue;
+        }
+        // a newline, a match, or a transition not built yet
+        int found;
+        if (c == newline) {
+            found = dfa->states[st].flags & REGEX_ACCEPT_END;
+            st = REGEX_LINE_START;
+        }
+        else {
+            if ((st = dfa_step(re, dfa, st, c)) < 0)
+                return -1;
+            next = dfa->next;
+            found = dfa->states[st].flags & REGEX_ACCEPT;
+        }
+        if (found) {
+            *state = st;
+            *used = i + 1;
+            return 1;
+        }
+    }
+    *state = st;
+    *used = len;
+    return 0;
+}
+
+int regex_scan_end(struct regex *re, int state) {
+    return (re->scan.states[state].flags & REGEX_ACCEPT_END) != 0;
+}
+
+int regex_line_matches(struct regex *re, const char *line, size_t len,
+                       int (*found)(void *arg, size_t start, size_t end),
+                       int (*stop)(void *arg), void *arg) {
+    const unsigned char *s = (const unsigned char *) line;
+    if (len > re->line_cap) {
+        unsigned char *starts = realloc(re->line_starts, len);
+        if (starts == NULL)
+            return -1;
+        re->line_starts = starts;
+        re->line_cap = len;
+    }
+    // going backwards from the end with the reversed pattern marks every byte that a
+    // match starts at
+    int st = REGEX_LINE_START;
+    int n_classes = re->n_classes;
+    for (size_t i = len; i-- > 0;) {
+        if (stop && i % REGEX_STEP == 0 && stop(arg))
+            return 1;
+        int c = re->byte_class[s[i]];
+        int next = re->starts.next[(size_t) st * n_classes + c];
+        if (next < 0 && (next = dfa_step(re, &re->starts, st, c)) < 0)
+            return -1;
+        st = next;
+        unsigned char flags = re->starts.states[st].flags;
+        re->line_starts[i] = (flags & (i == 0 ? REGEX_ACCEPT_END : REGEX_ACCEPT)) != 0;
+    }
+    // then each match goes as far as the pattern allows from the leftmost start not in an
+    // earlier match
+    size_t i = 0, check = REGEX_STEP;
+    while (i < len) {
+        if (stop && i >= check) {
+            if (stop(arg))
+                return 1;
+            check = i + REGEX_STEP;
+        }
+        if (!re->line_starts[i]) {
+            i++;
+            continue;
+        }
+        size_t end = i;
+        st = i == 0 ? REGEX_LINE_START : 2;
+        size_t j;
+        for (j = i; j < len && st != 0; j++) {
+            int c = re->byte_class[s[j]];
+            int next = re->longest.next[(size_t) st * n_classes + c];
+            if (next < 0 && (next = dfa_step(re, &re->longest, st, c)) < 0)
+                return -1;
+            st = next;
+            if (re->longest.states[st].flags & REGEX_ACCEPT)
+                end = j + 1;
+        }
+        if (j == len && (re->longest.states[st].flags & REGEX_ACCEPT_END))
+            end = len;
+        if (end == i) {
+            i++;
+            continue;
+        }
+        if (found(arg, i, end))
+            return 0;
+        i = end;
+    }
+    return 0;
+}
+
+static void dfa_free(struct regex_dfa *dfa) {
+    free(dfa->sets);
+    free(dfa->states);
+    free(dfa->next);
+    free(dfa->table);
+}
+
+void regex_free(struct regex *re) {
+    free(re->sets);
+    free(re->forward.insts);
+    free(re->reverse.insts);
+    dfa_free(&re->scan);
+    dfa_free(&re->starts);
+    dfa_free(&re->longest);
+    free(re->work);
+    free(re->mark);
+    free(re->line_starts);
+    memset(re, 0, sizeof(*re));
+}
@@ -0,0 +1,114 @@
+#ifndef KILO_REGEX_H
+#define KILO_REGEX_H
+
+#include <stddef.h>
+
+/*
+   Regular expressions for search, matched with a DFA that is built a state at a time as the
+   text needs it, so every byte costs a table lookup and nothing is ever tried twice.
+
+   Syntax: literal bytes, . [abc] [^a-z] \d \w \s (and \D \W \S), * + ?, |, (), ^ and $.
+   Any other escaped byte stands for itself. A match never takes in a newline, so every
+   match lies within one line, and empty matches are never reported.
+*/
+
+#define REGEX_DFA_MAX_STATES 4096 // states kept per DFA before its cache is thrown away
+#define REGEX_DFA_TABLE (2 * REGEX_DFA_MAX_STATES) // hash slots of a DFA's state cache
+#define REGEX_MAX_DEPTH 100 // nested groups a pattern may have
+#define REGEX_LITERAL_MAX 64 // longest literal kept, see literal
+#define REGEX_STEP (64 * 1024) // bytes regex_line_matches goes between calls to stop
+#define REGEX_LINE_START 1 // scan state at the start of a line, see regex_scan
+#define REGEX_ACCEPT (1 << 0)     // a match ends right here
+#define REGEX_ACCEPT_END (1 << 1) // one does if this is where the line ends
+
+// NFA instructions, also the kinds of parsed node that turn into them.
+enum regex_op {
+    REGEX_SET = 1,    // one byte from a set
+    REGEX_SPLIT,      // go on at both out and out1
+    REGEX_LINE_BEGIN, // ^
+    REGEX_LINE_END,   // $
+    REGEX_MATCH,
+};
+
+struct regex_inst {
+    unsigned char op;
+    int set; // REGEX_SET: index in sets
+    int out;
+    int out1; // REGEX_SPLIT only
+};
+
+// A Thompson NFA of the pattern, read forwards or backwards.
+struct regex_prog {
+    struct regex_inst *insts;
+    int n;
+    int cap;
+    int start;
+};
+
+struct regex_dstate {
+    size_t set; // offset in the DFA's sets of the NFA states, sorted
+    int n;
+    unsigned char flags; // REGEX_ACCEPT bits, for matches of at least one byte
+};
+
+// A DFA built lazily over a prog. State 0 is dead, 1 starts at a line boundary and 2 in the
+// middle of a line; these three survive the cache being thrown away, so their numbers hold.
+struct regex_dfa {
+    const struct regex_prog *prog;
+    int unanchored; // a match may start after every byte, not only at the start
+    int begin;      // assertion that holds where the scan starts, the other at its end
+    int end;
+    int *sets;
+    size_t sets_len;
+    size_t sets_cap;
+    struct regex_dstate *states;
+    int n_states;
+    int states_cap;
+    int *next;  // states_cap rows of n_classes next states, -1 if not built yet
+    int *table; // REGEX_DFA_TABLE slots, state + 1 or 0 if empty
+    unsigned flushes; // times the cache has been thrown away
+};
+
+struct regex {
+    unsigned char (*sets)[32]; // bitmaps of the bytes each REGEX_SET takes
+    int n_sets;
+    unsigned char byte_class[256]; // bytes no set tells apart share a class, and a column
+    unsigned char class_byte[256]; // a byte of each class
+    int n_classes;
+    char literal[REGEX_LITERAL_MAX]; // bytes that every match has one after the other
+    size_t literal_len;
+    struct regex_prog forward;
+    struct regex_prog reverse;
+    struct regex_dfa scan;     // forward, unanchored: finds lines with a match
+    struct regex_dfa starts;   // backward, unanchored: where in a line matches start
+    struct regex_dfa longest;  // forward, anchored: how far a match from a start goes
+    int *work;       // room for closures, see closure in kilo_regex.c
+    unsigned *mark;
+    unsigned gen;
+    unsigned char *line_starts; // per byte of the line being matched
+    size_t line_cap;
+};
+
+// Compiles pattern into re. Returns -1 if the pattern isn't valid or malloc fails.
+int regex_compile(struct regex *re, const char *pattern);
+
+// Runs along text[0..len) from state, looking for a line with a match; a line starts
+// after every '\n' and state is REGEX_LINE_START at the start of one. Stops with 1 right
+// after the byte at which the line is known to have a match, which may be the '\n' that
+// ends it, or with 0 at len. *used is how far it got and *state where it was then, to go on
+// from in the next piece of text. Returns -1 if malloc fails.
+int regex_scan(struct regex *re, int *state, const char *text, size_t len, size_t *used);
+
+// Whether a line ending in state without a '\n' (at the end of the document) has a match.
+int regex_scan_end(struct regex *re, int state);
+
+// Calls found with the start and end of every match in line[0..len), leftmost and longest
+// first, each match starting where the last one ended or later. Stops when found returns
+// non zero. stop, if not NULL, is asked every REGEX_STEP bytes whether to give up, for a
+// long line, and it returns 1 if it does. Returns -1 if malloc fails.
+int regex_line_matches(struct regex *re, const char *line, size_t len,
+                       int (*found)(void *arg, size_t start, size_t end),
+                       int (*stop)(void *arg), void *arg);
+
+void regex_free(struct regex *re);
+#endif
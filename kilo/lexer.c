@@ -0,0 +1,243 @@
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "editor.h"
+#include "highlighting.h"
+
+// Comment delimiters looked for in each mode.
+static const unsigned char lex_delims[LEX_MODES] = {
+    [LEX_MODE_SEP] = LEX_DELIM_SCS | LEX_DELIM_MCS,
+    [LEX_MODE_WORD] = LEX_DELIM_SCS | LEX_DELIM_MCS,
+    [LEX_MODE_NUMBER] = LEX_DELIM_SCS | LEX_DELIM_MCS,
+    [LEX_MODE_COMMENT] = LEX_DELIM_MCE,
+};
+
+int is_separator(int c) {
+    return isspace(c) || c == '\0' || strchr(",.()+-/*=~%<>[];", c) != NULL;
+}
+
+static int lex_is_separator(unsigned char class) {
+    return class <= LEX_DOT;
+}
+
+static int starts_with(const char *text, size_t len, const char *s, int s_len) {
+    return len >= (size_t) s_len && memcmp(text, s, s_len) == 0;
+}
+
+// Length of the keyword that makes up the whole word at s, or 0 if the word isn't one.
+static int match_keyword(const struct editor_syntax *syntax, const unsigned char *s, size_t len, unsigned char *hl) {
+    unsigned node = LEX_KW_ROOT;
+    size_t k = 0;
+    while (k < len && !lex_is_separator(syntax->char_class[s[k]])) {
+        node = syntax->kw_next[node * syntax->kw_classes + syntax->kw_class[s[k]]];
+        if (node == LEX_KW_DEAD)
+            return 0;
+        k++;
+    }
+    *hl = syntax->kw_hl[node];
+    return *hl ? k : 0;
+}
+
+// Sets the highlight of the n bytes at i, those before stop, in hl which starts at byte from.
+static void fill(unsigned char *hl, size_t from, size_t i, size_t n, size_t stop, unsigned char h) {
+    if (hl && i < stop)
+        memset(&hl[i - from], h, i + n < stop ? n : stop - i);
+}
+
+void editor_syntax_lex(const struct editor_syntax *syntax, const char *text, size_t len, size_t *pos,
+                       unsigned char *mode_at, size_t stop, unsigned char *hl) {
+    size_t from = *pos;
+    size_t i = *pos;
+    if (stop > len)
+        stop = len;
+    if (syntax == NULL || *mode_at == LEX_MODE_LINE_COMMENT) {
+        fill(hl, from, i, stop - i, stop, syntax ? HL_COMMENT : HL_NORMAL);
+        *pos = i > stop ? i : stop;
+        return;
+    }
+    const unsigned char *s = (const unsigned char *) text;
+    unsigned mode = *mode_at;
+    while (i < stop) {
+        unsigned char c = s[i];
+        unsigned char delim = syntax->delim_start[c] & lex_delims[mode];
+        if (delim) {
+            if ((delim & LEX_DELIM_SCS) && starts_with(&text[i], len - i, syntax->singleline_comment_start, syntax->scs_len)) {
+                fill(hl, from, i, len - i, stop, HL_COMMENT);
+                *pos = stop;
+                *mode_at = LEX_MODE_LINE_COMMENT;
+                return;
+            }
+            if ((delim & LEX_DELIM_MCS) && starts_with(&text[i], len - i, syntax->multiline_comment_start, syntax->mcs_len)) {
+                fill(hl, from, i, syntax->mcs_len, stop, HL_MLCOMMENT);
+                i += syntax->mcs_len;
+                mode = LEX_MODE_COMMENT;
+                continue;
+            }
+            if ((delim & LEX_DELIM_MCE) && starts_with(&text[i], len - i, syntax->multiline_comment_end, syntax->mce_len)) {
+                fill(hl, from, i, syntax->mce_len, stop, HL_MLCOMMENT);
+                i += syntax->mce_len;
+                mode = LEX_MODE_SEP;
+                continue;
+            }
+        }
+        unsigned char class = syntax->char_class[c];
+        unsigned char h = syntax->lex_hl[mode][class];
+        if (h == LEX_TRY_KEYWORD) {
+            int klen = match_keyword(syntax, &s[i], len - i, &h);
+            if (klen) {
+                fill(hl, from, i, klen, stop, h);
+                i += klen;
+                mode = LEX_MODE_WORD;
+                continue;
+            }
+            h = HL_NORMAL;
+        }
+        if (hl)
+            hl[i - from] = h;
+        i++;
+        mode = syntax->lex_next[mode][class];
+    }
+    *pos = i;
+    *mode_at = mode;
+}
+
+int editor_syntax_highlight(const struct editor_syntax *syntax, const char *text, int len, unsigned char *hl, int in_comment) {
+    size_t pos = 0;
+    unsigned char mode = in_comment ? LEX_MODE_COMMENT : LEX_MODE_SEP;
+    editor_syntax_lex(syntax, text, len, &pos, &mode, len, hl);
+    return syntax && mode == LEX_MODE_COMMENT;
+}
+
+static void lex_set(struct editor_syntax *syntax, unsigned mode, unsigned class, unsigned char hl, unsigned next) {
+    syntax->lex_hl[mode][class] = hl;
+    syntax->lex_next[mode][class] = next;
+}
+
+static void compile_modes(struct editor_syntax *syntax) {
+    // plain text: separators reset the word state, anything else is part of a word, and
+    // a word that starts after a separator might be a keyword
+    for (unsigned mode = 0; mode < LEX_MODES; mode++) {
+        for (unsigned class = 0; class < LEX_CLASSES; class++) {
+            unsigned char hl = (mode == LEX_MODE_SEP && !lex_is_separator(class)) ? LEX_TRY_KEYWORD : HL_NORMAL;
+            lex_set(syntax, mode, class, hl, lex_is_separator(class) ? LEX_MODE_SEP : LEX_MODE_WORD);
+        }
+    }
+    if (syntax->flags & HL_HIGHLIGHT_NUMBERS) {
+        lex_set(syntax, LEX_MODE_SEP, LEX_DIGIT, HL_NUMBER, LEX_MODE_NUMBER);
+        lex_set(syntax, LEX_MODE_NUMBER, LEX_DIGIT, HL_NUMBER, LEX_MODE_NUMBER);
+        lex_set(syntax, LEX_MODE_NUMBER, LEX_DOT, HL_NUMBER, LEX_MODE_NUMBER);
+    }
+    if (syntax->flags & HL_HIGHLIGHT_STRINGS) {
+        unsigned plain[] = { LEX_MODE_SEP, LEX_MODE_WORD, LEX_MODE_NUMBER };
+        for (unsigned j = 0; j < sizeof(plain) / sizeof(plain[0]); j++) {
+            lex_set(syntax, plain[j], LEX_DQUOTE, HL_STRING, LEX_MODE_DQ);
+            lex_set(syntax, plain[j], LEX_SQUOTE, HL_STRING, LEX_MODE_SQ);
+        }
+        for (unsigned class = 0; class < LEX_CLASSES; class++) {
+            lex_set(syntax, LEX_MODE_DQ, class, HL_STRING, LEX_MODE_DQ);
+            lex_set(syntax, LEX_MODE_SQ, class, HL_STRING, LEX_MODE_SQ);
+            lex_set(syntax, LEX_MODE_DQ_ESC, class, HL_STRING, LEX_MODE_DQ);
+            lex_set(syntax, LEX_MODE_SQ_ESC, class, HL_STRING, LEX_MODE_SQ);
+        }
+        lex_set(syntax, LEX_MODE_DQ, LEX_BACKSLASH, HL_STRING, LEX_MODE_DQ_ESC);
+        lex_set(syntax, LEX_MODE_SQ, LEX_BACKSLASH, HL_STRING, LEX_MODE_SQ_ESC);
+        lex_set(syntax, LEX_MODE_DQ, LEX_DQUOTE, HL_STRING, LEX_MODE_SEP);
+        lex_set(syntax, LEX_MODE_SQ, LEX_SQUOTE, HL_STRING, LEX_MODE_SEP);
+    }
+    for (unsigned class = 0; class < LEX_CLASSES; class++)
+        lex_set(syntax, LEX_MODE_COMMENT, class, HL_MLCOMMENT, LEX_MODE_COMMENT);
+}
+
+// Builds the keyword trie as a DFA over the bytes that occur in keywords.
+static int compile_keywords(struct editor_syntax *syntax) {
+    size_t total = 0;
+    memset(syntax->kw_class, 0, sizeof(syntax->kw_class));
+    syntax->kw_classes = 1; // column 0 is every byte no keyword contains
+    for (size_t j = 0; syntax->keywords[j]; j++) {
+        // telling a keyword from a longer word takes looking at the byte after it
+        int klen = strlen(syntax->keywords[j]);
+        if (klen + 1 > syntax->lookahead)
+            syntax->lookahead = klen + 1;
+        for (const unsigned char *p = (const unsigned char *) syntax->keywords[j]; *p; p++) {
+            if (!syntax->kw_class[*p])
+                syntax->kw_class[*p] = syntax->kw_classes++;
+            total++;
+        }
+    }
+    size_t nodes = total + 2;
+    syntax->kw_next = calloc(nodes * syntax->kw_classes, sizeof(uint16_t));
+    syntax->kw_hl = calloc(nodes, 1);
+    if (syntax->kw_next == NULL || syntax->kw_hl == NULL || nodes > UINT16_MAX) {
+        free(syntax->kw_next);
+        free(syntax->kw_hl);
+        return -1;
+    }
+    unsigned used = LEX_KW_ROOT + 1;
+    for (size_t j = 0; syntax->keywords[j]; j++) {
+        const char *kw = syntax->keywords[j];
+        int klen = strlen(kw);
+        int kw2 = klen > 0 && kw[klen - 1] == '|';
+        if (kw2)
+            klen--;
+        unsigned node = LEX_KW_ROOT;
+        for (int k = 0; k < klen; k++) {
+            uint16_t *next = &syntax->kw_next[node * syntax->kw_classes + syntax->kw_class[(unsigned char) kw[k]]];
+            if (*next == LEX_KW_DEAD)
+                *next = used++;
+            node = *next;
+        }
+        if (klen)
+            syntax->kw_hl[node] = kw2 ? HL_KEYWORD2 : HL_KEYWORD1;
+    }
+    return 0;
+}
+
+int editor_syntax_compile(struct editor_syntax *syntax) {
+    if (syntax->compiled)
+        return 0;
+    char *scs = syntax->singleline_comment_start;
+    char *mcs = syntax->multiline_comment_start;
+    char *mce = syntax->multiline_comment_end;
+    syntax->scs_len = scs ? strlen(scs) : 0;
+    syntax->mcs_len = mcs ? strlen(mcs) : 0;
+    syntax->mce_len = mce ? strlen(mce) : 0;
+    if (!syntax->mcs_len || !syntax->mce_len)
+        syntax->mcs_len = syntax->mce_len = 0; // block comments need both ends
+    syntax->lookahead = 1;
+    if (syntax->scs_len > syntax->lookahead)
+        syntax->lookahead = syntax->scs_len;
+    if (syntax->mcs_len > syntax->lookahead)
+        syntax->lookahead = syntax->mcs_len;
+    if (syntax->mce_len > syntax->lookahead)
+        syntax->lookahead = syntax->mce_len;
+
+    memset(syntax->delim_start, 0, sizeof(syntax->delim_start));
+    if (syntax->scs_len)
+        syntax->delim_start[(unsigned char) scs[0]] |= LEX_DELIM_SCS;
+    if (syntax->mcs_len) {
+        syntax->delim_start[(unsigned char) mcs[0]] |= LEX_DELIM_MCS;
+        syntax->delim_start[(unsigned char) mce[0]] |= LEX_DELIM_MCE;
+    }
+    for (int c = 0; c < 256; c++) {
+        unsigned char class = LEX_WORD;
+        if (c == '.')
+            class = LEX_DOT;
+        else if (is_separator(c))
+            class = LEX_SEP;
+        else if (isdigit(c))
+            class = LEX_DIGIT;
+        else if (c == '"')
+            class = LEX_DQUOTE;
+        else if (c == '\'')
+            class = LEX_SQUOTE;
+        else if (c == '\\')
+            class = LEX_BACKSLASH;
+        syntax->char_class[c] = class;
+    }
+    compile_modes(syntax);
+    if (compile_keywords(syntax) != 0)
+        return -1;
+    syntax->compiled = 1;
+    return 0;
+}
@@ -0,0 +1,176 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "line_index.h"
+#include "piece_table.h"
+
+/*
+   Typing and large edits on a BENCH_FILE_SIZE document, once with kilo's old row array
+   (a malloc'd copy of every line in a realloc'd array of rows) and once with the piece
+   table. Prints CSV:
+
+       edit,storage,ops,seconds,ns_per_op
+
+   The row array is stopped once an edit goes over the time budget; ops says how many of
+   them it got through.
+
+   Usage: ./piece_bench [file_mb] [budget_seconds]
+*/
+
+#define BENCH_FILE_SIZE (100UL * 1024 * 1024)
+#define BENCH_LINE_LEN 64
+#define BENCH_TYPED 100000
+#define BENCH_SCATTERED 10000
+#define BENCH_BLOCK_SIZE (10UL * 1024 * 1024)
+#define BENCH_BUDGET 2.0
+
+struct row {
+    size_t size;
+    char *chars;
+};
+
+struct rows {
+    struct row *row;
+    size_t n_rows;
+};
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *edit, const char *storage, size_t ops, double t) {
+    printf("%s,%s,%zu,%.4f,%.1f\n", edit, storage, ops, t, ops ? t * 1e9 / ops : 0);
+    fflush(stdout);
+}
+
+// editor_insert_row, without render and hl
+static void rows_insert(struct rows *rows, const char *s, size_t len, size_t at) {
+    rows->row = realloc(rows->row, sizeof(struct row) * (rows->n_rows + 1));
+    memmove(&rows->row[at + 1], &rows->row[at], sizeof(struct row) * (rows->n_rows - at));
+    rows->row[at].size = len;
+    rows->row[at].chars = malloc(len + 1);
+    memcpy(rows->row[at].chars, s, len);
+    rows->row[at].chars[len] = '\0';
+    rows->n_rows++;
+}
+
+// e_row_insert_char
+static void rows_insert_char(struct rows *rows, size_t y, size_t x, char c) {
+    struct row *row = &rows->row[y];
+    row->chars = realloc(row->chars, row->size + 2);
+    memmove(&row->chars[x + 1], &row->chars[x], row->size - x + 1);
+    row->chars[x] = c;
+    row->size++;
+}
+
+static void rows_delete(struct rows *rows, size_t at) {
+    free(rows->row[at].chars);
+    memmove(&rows->row[at], &rows->row[at + 1], sizeof(struct row) * (rows->n_rows - at - 1));
+    rows->n_rows--;
+}
+
+static void rows_free(struct rows *rows) {
+    for (size_t i = 0; i < rows->n_rows; i++) free(rows->row[i].chars);
+    free(rows->row);
+    rows->row = NULL;
+    rows->n_rows = 0;
+}
+
+int main(int argc, char *argv[]) {
+    size_t size = argc > 1 ? strtoull(argv[1], NULL, 10) * 1024 * 1024 : BENCH_FILE_SIZE;
+    double budget = argc > 2 ? atof(argv[2]) : BENCH_BUDGET;
+
+    char *file = malloc(size);
+    for (size_t i = 0; i < size; i++) file[i] = (i % BENCH_LINE_LEN == BENCH_LINE_LEN - 1) ? '\n' : 'a' + i % 26;
+    char *block = malloc(BENCH_BLOCK_SIZE);
+    memcpy(block, file, BENCH_BLOCK_SIZE < size ? BENCH_BLOCK_SIZE : size);
+    LineIndex lines;
+    if (line_index_build(&lines, file, size, '\n', 0) != 0) {
+        fprintf(stderr, "could not index the file\n");
+        return 1;
+    }
+    size_t mid = lines.count / 2;
+    srand(1);
+
+    printf("edit,storage,ops,seconds,ns_per_op\n");
+
+    // open
+    struct rows rows = { NULL, 0 };
+    double t = now();
+    for (size_t i = 0; i < lines.count; i++) {
+        rows_insert(&rows, &file[lines.offsets[i]], line_index_line_len(&lines, file, size, i), rows.n_rows);
+    }
+    report("open", "rows", 1, now() - t);
+    struct piece_table pt;
+    t = now();
+    piece_table_init(&pt, file, size, lines.offsets, lines.count);
+    report("open", "piece_table", 1, now() - t);
+
+    // typing in the middle of the file: find the line, insert at the cursor
+    t = now();
+    for (size_t i = 0; i < BENCH_TYPED; i++) rows_insert_char(&rows, mid, i % BENCH_LINE_LEN, 'x');
+    report("type_one_line", "rows", BENCH_TYPED, now() - t);
+    t = now();
+    for (size_t i = 0; i < BENCH_TYPED; i++) {
+        piece_table_insert(&pt, piece_table_line_offset(&pt, mid) + i, "x", 1);
+    }
+    report("type_one_line", "piece_table", BENCH_TYPED, now() - t);
+
+    // typing a character on random lines, so every keystroke is a new piece
+    t = now();
+    for (size_t i = 0; i < BENCH_SCATTERED; i++) rows_insert_char(&rows, rand() % rows.n_rows, 0, 'y');
+    report("type_scattered", "rows", BENCH_SCATTERED, now() - t);
+    t = now();
+    for (size_t i = 0; i < BENCH_SCATTERED; i++) {
+        piece_table_insert(&pt, piece_table_line_offset(&pt, rand() % lines.count), "y", 1);
+    }
+    report("type_scattered", "piece_table", BENCH_SCATTERED, now() - t);
+
+    // pasting a BENCH_BLOCK_SIZE block in the middle: one editor_insert_row per line
+    LineIndex block_lines;
+    line_index_build(&block_lines, block, BENCH_BLOCK_SIZE, '\n', 1);
+    size_t ops = 0;
+    t = now();
+    for (; ops < block_lines.count && now() - t < budget; ops++) {
+        rows_insert(&rows, &block[block_lines.offsets[ops]],
+                    line_index_line_len(&block_lines, block, BENCH_BLOCK_SIZE, ops), mid + ops);
+    }
+    t = now() - t;
+    report("paste_10mb", "rows", ops, t);
+    if (ops < block_lines.count)
+        fprintf(stderr, "rows: paste stopped after %zu of %zu lines, about %.0f s for all of it\n",
+                ops, block_lines.count, t * block_lines.count / ops);
+    t = now();
+    piece_table_insert(&pt, piece_table_line_offset(&pt, mid), block, BENCH_BLOCK_SIZE);
+    report("paste_10mb", "piece_table", 1, now() - t);
+
+    // deleting half of the file's lines from the middle
+    size_t victims = lines.count / 2;
+    size_t first = lines.count / 4;
+    ops = 0;
+    t = now();
+    for (; ops < victims && now() - t < budget; ops++) rows_delete(&rows, first);
+    t = now() - t;
+    report("delete_half", "rows", ops, t);
+    if (ops < victims)
+        fprintf(stderr, "rows: delete stopped after %zu of %zu lines, about %.0f s for all of it\n",
+                ops, victims, t * victims / ops);
+    t = now();
+    size_t start = piece_table_line_offset(&pt, first);
+    piece_table_delete(&pt, start, piece_table_line_offset(&pt, first + victims) - start);
+    report("delete_half", "piece_table", 1, now() - t);
+
+    fprintf(stderr, "piece_table: %zu pieces, %zu bytes in the add buffer\n", pt.n_pieces, pt.add_len);
+    rows_free(&rows);
+    piece_table_free(&pt);
+    line_index_free(&block_lines);
+    line_index_free(&lines);
+    free(block);
+    free(file);
+    return 0;
+}
@@ -0,0 +1,363 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#include "piece_table.h"
+
+static const char *source_text(const struct piece_table *pt, enum piece_source source) {
+    return source == PIECE_ORIGINAL ? pt->original : pt->add;
+}
+
+// Number of original line starts at or before pos.
+static size_t starts_up_to(const struct piece_table *pt, size_t pos) {
+    size_t lo = 0, hi = pt->line_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (pt->line_starts[mid] <= pos) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static int indexed(const struct piece_table *pt, enum piece_source source) {
+    return source == PIECE_ORIGINAL && pt->line_starts;
+}
+
+// Number of add buffer newlines before pos.
+static size_t add_newlines_before(const struct piece_table *pt, size_t pos) {
+    size_t lo = 0, hi = pt->add_newlines_len;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (pt->add_newlines[mid] < pos) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// Newlines in [start, start + len) of a source buffer.
+static size_t count_newlines(const struct piece_table *pt, enum piece_source source, size_t start, size_t len) {
+    if (len == 0)
+        return 0;
+    if (indexed(pt, source)) {
+        // the newline before every line start in (start, start + len], plus the last
+        // newline of the file, which starts no line
+        size_t n = starts_up_to(pt, start + len) - starts_up_to(pt, start);
+        if (start + len == pt->original_len && pt->original[pt->original_len - 1] == '\n')
+            n++;
+        return n;
+    }
+    if (source == PIECE_ADD)
+        return add_newlines_before(pt, start + len) - add_newlines_before(pt, start);
+    const char *p = source_text(pt, source) + start;
+    const char *end = p + len;
+    size_t n = 0;
+    while ((p = memchr(p, '\n', end - p))) {
+        n++;
+        p++;
+    }
+    return n;
+}
+
+// Offset inside piece of its k-th newline (0 based). k has to be below piece->newlines.
+static size_t nth_newline(const struct piece_table *pt, const struct piece *piece, size_t k) {
+    if (indexed(pt, piece->source)) {
+        size_t i = starts_up_to(pt, piece->start) + k;
+        size_t pos = i < pt->line_count ? pt->line_starts[i] - 1 : pt->original_len - 1;
+        return pos - piece->start;
+    }
+    if (piece->source == PIECE_ADD)
+        return pt->add_newlines[add_newlines_before(pt, piece->start) + k] - piece->start;
+    const char *text = source_text(pt, piece->source) + piece->start;
+    const char *p = text;
+    for (;;) {
+        p = memchr(p, '\n', piece->len - (p - text));
+        if (k-- == 0)
+            return p - text;
+        p++;
+    }
+}
+
+// Index of the piece holding pos and the offset of pos inside it. A pos on a boundary belongs
+// to the piece that starts there; the document length gives n_pieces.
+static size_t piece_at(const struct piece_table *pt, size_t pos, size_t *off) {
+    size_t i = 0;
+    while (i < pt->n_pieces && pos >= pt->pieces[i].len) {
+        pos -= pt->pieces[i].len;
+        i++;
+    }
+    *off = pos;
+    return i;
+}
+
+static int reserve_pieces(struct piece_table *pt, size_t extra) {
+    if (pt->n_pieces + extra <= pt->pieces_cap)
+        return 0;
+    size_t cap = pt->pieces_cap * 2;
+    if (cap < pt->n_pieces + extra)
+        cap = pt->n_pieces + extra;
+    struct piece *pieces = realloc(pt->pieces, cap * sizeof(struct piece));
+    if (pieces == NULL)
+        return -1;
+    pt->pieces = pieces;
+    pt->pieces_cap = cap;
+    return 0;
+}
+
+static int reserve_add(struct piece_table *pt, size_t extra) {
+    if (pt->add_len + extra <= pt->add_cap)
+        return 0;
+    size_t cap = pt->add_cap ? pt->add_cap * 2 : PIECE_TABLE_INITIAL_ADD;
+    while (cap < pt->add_len + extra)
+        cap *= 2;
+    char *add = realloc(pt->add, cap);
+    if (add == NULL)
+        return -1;
+    pt->add = add;
+    pt->add_cap = cap;
+    return 0;
+}
+
+static int reserve_add_newlines(struct piece_table *pt, size_t extra) {
+    if (pt->add_newlines_len + extra <= pt->add_newlines_cap)
+        return 0;
+    size_t cap = pt->add_newlines_cap ? pt->add_newlines_cap * 2 : 1024;
+    while (cap < pt->add_newlines_len + extra)
+        cap *= 2;
+    size_t *add_newlines = realloc(pt->add_newlines, cap * sizeof(size_t));
+    if (add_newlines == NULL)
+        return -1;
+    pt->add_newlines = add_newlines;
+    pt->add_newlines_cap = cap;
+    return 0;
+}
+
+int piece_table_init(struct piece_table *pt, const char *original, size_t len, const uint64_t *line_starts, size_t line_count) {
+    memset(pt, 0, sizeof(*pt));
+    pt->pieces = malloc(PIECE_TABLE_INITIAL_PIECES * sizeof(struct piece));
+    if (pt->pieces == NULL)
+        return -1;
+    pt->pieces_cap = PIECE_TABLE_INITIAL_PIECES;
+    pt->original = original;
+    pt->original_len = len;
+    pt->line_starts = line_starts;
+    pt->line_count = line_count;
+    if (len) {
+        pt->pieces[0].source = PIECE_ORIGINAL;
+        pt->pieces[0].start = 0;
+        pt->pieces[0].len = len;
+        pt->pieces[0].newlines = count_newlines(pt, PIECE_ORIGINAL, 0, len);
+        pt->n_pieces = 1;
+        pt->len = len;
+        pt->newlines = pt->pieces[0].newlines;
+    }
+    return 0;
+}
+
+int piece_table_insert(struct piece_table *pt, size_t pos, const char *s, size_t len) {
+    if (len == 0)
+        return 0;
+    if (pos > pt->len)
+        pos = pt->len;
+    size_t newlines = 0;
+    for (const char *p = s; (p = memchr(p, '\n', s + len - p)) != NULL; p++)
+        newlines++;
+    if (reserve_add(pt, len) != 0 || reserve_pieces(pt, 2) != 0 || reserve_add_newlines(pt, newlines) != 0)
+        return -1;
+    size_t added_start = pt->add_len;
+    memcpy(&pt->add[added_start], s, len);
+    pt->add_len += len;
+    for (const char *p = s; (p = memchr(p, '\n', s + len - p)) != NULL; p++)
+        pt->add_newlines[pt->add_newlines_len++] = added_start + (p - s);
+    pt->len += len;
+    pt->newlines += newlines;
+
+    size_t off;
+    size_t i = piece_at(pt, pos, &off);
+    // typing: the piece before pos ends where the add buffer did, so it just grows
+    struct piece *prev = (off == 0 && i > 0) ? &pt->pieces[i - 1] : NULL;
+    if (prev && prev->source == PIECE_ADD && prev->start + prev->len == added_start) {
+        prev->len += len;
+        prev->newlines += newlines;
+        return 0;
+    }
+
+    struct piece added = { PIECE_ADD, added_start, len, newlines };
+    if (off == 0) {
+        memmove(&pt->pieces[i + 1], &pt->pieces[i], (pt->n_pieces - i) * sizeof(struct piece));
+        pt->pieces[i] = added;
+        pt->n_pieces++;
+        return 0;
+    }
+    // split piece i around pos
+    struct piece *left = &pt->pieces[i];
+    struct piece right = *left;
+    left->len = off;
+    left->newlines = count_newlines(pt, left->source, left->start, off);
+    right.start += off;
+    right.len -= off;
+    right.newlines -= left->newlines;
+    memmove(&pt->pieces[i + 3], &pt->pieces[i + 1], (pt->n_pieces - i - 1) * sizeof(struct piece));
+    pt->pieces[i + 1] = added;
+    pt->pieces[i + 2] = right;
+    pt->n_pieces += 2;
+    return 0;
+}
+
+int piece_table_delete(struct piece_table *pt, size_t pos, size_t len) {
+    if (pos >= pt->len)
+        return 0;
+    if (len > pt->len - pos)
+        len = pt->len - pos;
+    if (len == 0)
+        return 0;
+    size_t off;
+    size_t i = piece_at(pt, pos, &off);
+    struct piece *piece = &pt->pieces[i];
+
+    if (off > 0 && off + len < piece->len) {
+        // the range is inside one piece, which becomes two
+        if (reserve_pieces(pt, 1) != 0)
+            return -1;
+        piece = &pt->pieces[i];
+        size_t removed = count_newlines(pt, piece->source, piece->start + off, len);
+        struct piece right = *piece;
+        piece->len = off;
+        piece->newlines = count_newlines(pt, piece->source, piece->start, off);
+        right.start += off + len;
+        right.len -= off + len;
+        right.newlines -= piece->newlines + removed;
+        memmove(&pt->pieces[i + 2], &pt->pieces[i + 1], (pt->n_pieces - i - 1) * sizeof(struct piece));
+        pt->pieces[i + 1] = right;
+        pt->n_pieces++;
+        pt->len -= len;
+        pt->newlines -= removed;
+        return 0;
+    }
+
+    size_t remaining = len;
+    if (off > 0) {
+        // cut the tail off the first piece
+        size_t cut = piece->len - off;
+        size_t removed = count_newlines(pt, piece->source, piece->start + off, cut);
+        piece->len = off;
+        piece->newlines -= removed;
+        pt->newlines -= removed;
+        remaining -= cut;
+        i++;
+    }
+    size_t first_gone = i;
+    while (remaining > 0 && pt->pieces[i].len <= remaining) {
+        remaining -= pt->pieces[i].len;
+        pt->newlines -= pt->pieces[i].newlines;
+        i++;
+    }
+    if (remaining > 0) {
+        // and the head off the last one
+        piece = &pt->pieces[i];
+        size_t removed = count_newlines(pt, piece->source, piece->start, remaining);
+        piece->start += remaining;
+        piece->len -= remaining;
+        piece->newlines -= removed;
+        pt->newlines -= removed;
+    }
+    memmove(&pt->pieces[first_gone], &pt->pieces[i], (pt->n_pieces - i) * sizeof(struct piece));
+    pt->n_pieces -= i - first_gone;
+    pt->len -= len;
+    return 0;
+}
+
+size_t piece_table_line_offset(const struct piece_table *pt, size_t line) {
+    if (line == 0)
+        return 0;
+    size_t k = line - 1; // line starts after the document's k-th newline
+    size_t pos = 0;
+    for (size_t i = 0; i < pt->n_pieces; i++) {
+        const struct piece *piece = &pt->pieces[i];
+        if (k < piece->newlines)
+            return pos + nth_newline(pt, piece, k) + 1;
+        k -= piece->newlines;
+        pos += piece->len;
+    }
+    return pt->len;
+}
+
+size_t piece_table_line_at(const struct piece_table *pt, size_t pos) {
+    size_t line = 0;
+    for (size_t i = 0; i < pt->n_pieces; i++) {
+        const struct piece *piece = &pt->pieces[i];
+        if (pos < piece->len)
+            return line + count_newlines(pt, piece->source, piece->start, pos);
+        line += piece->newlines;
+        pos -= piece->len;
+    }
+    return line;
+}
+
+size_t piece_table_read(const struct piece_table *pt, size_t pos, size_t len, char *out) {
+    if (pos >= pt->len)
+        return 0;
+    size_t off;
+    size_t i = piece_at(pt, pos, &off);
+    size_t copied = 0;
+    while (copied < len && i < pt->n_pieces) {
+        const struct piece *piece = &pt->pieces[i];
+        size_t n = piece->len - off;
+        if (n > len - copied)
+            n = len - copied;
+        memcpy(&out[copied], source_text(pt, piece->source) + piece->start + off, n);
+        copied += n;
+        off = 0;
+        i++;
+    }
+    return copied;
+}
+
+// Writes all of iov[0..n), going again from where a short write stopped.
+static int write_iovs(int fd, struct iovec *iov, int n) {
+    while (n > 0) {
+        ssize_t written = writev(fd, iov, n);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        while (n > 0 && (size_t) written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            n--;
+        }
+        if (n > 0) {
+            iov->iov_base = (char *) iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+    return 0;
+}
+
+int piece_table_write(const struct piece_table *pt, int fd, size_t len) {
+    struct iovec iov[PIECE_TABLE_WRITE_IOVS];
+    size_t i = 0;
+    while (len > 0 && i < pt->n_pieces) {
+        int n = 0;
+        for (; n < PIECE_TABLE_WRITE_IOVS && len > 0 && i < pt->n_pieces; i++) {
+            size_t piece_len = pt->pieces[i].len < len ? pt->pieces[i].len : len;
+            iov[n++] = (struct iovec) { (void *) piece_table_piece_data(pt, i), piece_len };
+            len -= piece_len;
+        }
+        if (write_iovs(fd, iov, n) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+const char *piece_table_piece_data(const struct piece_table *pt, size_t i) {
+    return source_text(pt, pt->pieces[i].source) + pt->pieces[i].start;
+}
+
+void piece_table_free(struct piece_table *pt) {
+    free(pt->pieces);
+    free(pt->add);
+    free(pt->add_newlines);
+    memset(pt, 0, sizeof(*pt));
+}
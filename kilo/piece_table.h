@@ -0,0 +1,75 @@
+#ifndef __PIECE_TABLE_H
+#define __PIECE_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PIECE_TABLE_INITIAL_PIECES 16
+#define PIECE_TABLE_INITIAL_ADD (64 * 1024)
+#define PIECE_TABLE_WRITE_IOVS 1024 // pieces per writev, IOV_MAX on Linux
+
+enum piece_source {
+    PIECE_ORIGINAL,
+    PIECE_ADD,
+};
+
+// A run of the document taken from one of the two buffers.
+struct piece {
+    enum piece_source source;
+    size_t start;
+    size_t len;
+    size_t newlines;
+};
+
+// The document as a list of pieces over two buffers: the original file, which is never
+// written to, and an append-only add buffer that every inserted byte goes into. Inserting
+// or deleting only splits and trims pieces, so an edit costs O(pieces) no matter how big
+// the file is, and no text is ever moved.
+struct piece_table {
+    const char *original;
+    size_t original_len;
+    const uint64_t *line_starts; // optional line index of original, see piece_table_init
+    size_t line_count;
+    char *add;
+    size_t add_len;
+    size_t add_cap;
+    size_t *add_newlines; // offset of every newline in add, so add pieces are indexed too
+    size_t add_newlines_len;
+    size_t add_newlines_cap;
+    struct piece *pieces;
+    size_t n_pieces;
+    size_t pieces_cap;
+    size_t len;
+    size_t newlines;
+};
+
+// Starts a document holding original[0..len). original is not copied and has to stay alive
+// and unchanged (e.g. mapped) until piece_table_free. line_starts can be the start offsets of
+// original's lines from a LineIndex, which makes splitting original pieces and finding lines
+// in them O(log n) instead of a scan; it may be NULL. Returns -1 if malloc fails.
+int piece_table_init(struct piece_table *pt, const char *original, size_t len, const uint64_t *line_starts, size_t line_count);
+
+// Inserts s[0..len) at offset pos. Returns -1 if malloc fails, leaving the document unchanged.
+int piece_table_insert(struct piece_table *pt, size_t pos, const char *s, size_t len);
+
+// Removes len bytes starting at pos. Returns -1 if malloc fails.
+int piece_table_delete(struct piece_table *pt, size_t pos, size_t len);
+
+// Offset of the first byte of line (0 based), or the document length past the last line.
+size_t piece_table_line_offset(const struct piece_table *pt, size_t line);
+
+// Line (0 based) that the byte at pos is on.
+size_t piece_table_line_at(const struct piece_table *pt, size_t pos);
+
+// Copies up to len bytes starting at pos into out. Returns the number of bytes copied.
+size_t piece_table_read(const struct piece_table *pt, size_t pos, size_t len, char *out);
+
+// Writes the first len bytes of the document to fd straight out of the pieces, with a
+// writev for every PIECE_TABLE_WRITE_IOVS of them. Returns -1 if a write fails.
+int piece_table_write(const struct piece_table *pt, int fd, size_t len);
+
+// Text of piece i.
+const char *piece_table_piece_data(const struct piece_table *pt, size_t i);
+
+void piece_table_free(struct piece_table *pt);
+#endif
@@ -0,0 +1,184 @@
+#include <regex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "kilo_regex.h"
+
+/*
+   Times compiling a pattern and finding its first match in a line of n bytes, for patterns
+   that take backtracking engines time exponential in n, with three engines:
+
+       dfa        kilo's lazy DFA (regex_line_matches)
+       backtrack  the same NFA walked depth first, trying one path after another the way
+                  backtracking engines do
+       glibc      regcomp/regexec
+
+   "a?^n a^n" is the pattern a? written n times then a written n times, against n a's, so
+   it grows with the input. Backtracking gives up after BENCH_STEPS steps; an engine that
+   takes more than BENCH_BUDGET seconds on one size isn't run on the bigger ones. Prints CSV:
+
+       pattern,n,engine,matched,us
+
+   Usage: ./regex_bench [max_n]
+*/
+
+#define BENCH_STEPS 2000000000L
+#define BENCH_BUDGET 1.0
+#define BENCH_REPS 100
+#define BENCH_REPEAT_TIME 0.01
+
+enum { ENGINE_DFA, ENGINE_BACKTRACK, ENGINE_GLIBC, ENGINES };
+static const char *engine_names[ENGINES] = {"dfa", "backtrack", "glibc"};
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long steps;
+
+// 1 if the NFA matches text from sp on, 0 if not, -1 once BENCH_STEPS have been taken.
+static int backtrack(const struct regex *re, int pc, const char *sp, const char *text, const char *end) {
+    for (;;) {
+        if (++steps > BENCH_STEPS)
+            return -1;
+        const struct regex_inst *inst = &re->forward.insts[pc];
+        int r;
+        switch (inst->op) {
+        case REGEX_SET:
+            if (sp == end || !(re->sets[inst->set][(unsigned char) *sp >> 3] & (1 << (*sp & 7))))
+                return 0;
+            sp++;
+            pc = inst->out;
+            break;
+        case REGEX_SPLIT:
+            if ((r = backtrack(re, inst->out, sp, text, end)) != 0)
+                return r;
+            pc = inst->out1;
+            break;
+        case REGEX_LINE_BEGIN:
+            if (sp != text)
+                return 0;
+            pc = inst->out;
+            break;
+        case REGEX_LINE_END:
+            if (sp != end)
+                return 0;
+            pc = inst->out;
+            break;
+        default:
+            return 1;
+        }
+    }
+}
+
+static int backtrack_search(const struct regex *re, const char *text, size_t len) {
+    steps = 0;
+    for (size_t i = 0; i <= len; i++) {
+        int r = backtrack(re, re->forward.start, &text[i], text, &text[len]);
+        if (r != 0)
+            return r;
+    }
+    return 0;
+}
+
+static int first_match(void *arg, size_t start, size_t end) {
+    (void) start;
+    (void) end;
+    *(int *) arg = 1;
+    return 1;
+}
+
+// Compiles pattern and runs engine on text; returns 1 if it matched, 0 if not and -1 if it
+// gave up. *us is the time one compile and run took.
+static int run(int engine, const char *pattern, const char *text, size_t len, double *us) {
+    int matched = 0;
+    int reps = 0;
+    double t = now();
+    // quick runs are repeated to be measurable
+    while (matched >= 0 && reps < BENCH_REPS && (reps == 0 || now() - t < BENCH_REPEAT_TIME)) {
+        reps++;
+        struct regex re;
+        regex_t posix;
+        regmatch_t m;
+        int bad = engine == ENGINE_GLIBC ? regcomp(&posix, pattern, REG_EXTENDED) : regex_compile(&re, pattern);
+        if (bad) {
+            fprintf(stderr, "could not compile %s\n", pattern);
+            exit(1);
+        }
+        switch (engine) {
+        case ENGINE_DFA:
+            matched = 0;
+            regex_line_matches(&re, text, len, first_match, NULL, &matched);
+            break;
+        case ENGINE_BACKTRACK:
+            matched = backtrack_search(&re, text, len);
+            break;
+        case ENGINE_GLIBC:
+            matched = regexec(&posix, text, 1, &m, 0) == 0;
+            break;
+        }
+        if (engine == ENGINE_GLIBC)
+            regfree(&posix);
+        else
+            regex_free(&re);
+    }
+    *us = (now() - t) * 1e6 / reps;
+    return matched;
+}
+
+int main(int argc, char *argv[]) {
+    size_t max_n = argc > 1 ? strtoull(argv[1], NULL, 10) : 1 << 20;
+    struct {
+        const char *name;
+        const char *pattern; // NULL for a?^n a^n
+        char fill;
+    } cases[] = {
+        {"(a|aa)*c", "(a|aa)*c", 'a'},
+        {"(x+x+)+y", "(x+x+)+y", 'x'},
+        {"a?^n a^n", NULL, 'a'},
+    };
+    char *text = malloc(max_n + 1);
+    char *pattern = malloc(5 * max_n + 1);
+    if (text == NULL || pattern == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    printf("pattern,n,engine,matched,us\n");
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        int skip[ENGINES] = { 0 };
+        // the growing pattern makes every size cost n times more, so it stops sooner
+        size_t last = cases[c].pattern ? max_n : (max_n < 4096 ? max_n : 4096);
+        for (size_t n = 8; n <= last; n *= 2) {
+            memset(text, cases[c].fill, n);
+            text[n] = '\0';
+            const char *p = cases[c].pattern;
+            if (p == NULL) {
+                size_t len = 0;
+                for (size_t i = 0; i < n; i++) {
+                    pattern[len++] = 'a';
+                    pattern[len++] = '?';
+                }
+                memset(&pattern[len], 'a', n);
+                pattern[len + n] = '\0';
+                p = pattern;
+            }
+            for (int e = 0; e < ENGINES; e++) {
+                if (skip[e])
+                    continue;
+                double us;
+                int matched = run(e, p, text, n, &us);
+                if (matched < 0)
+                    printf("%s,%zu,%s,gave up,%.1f\n", cases[c].name, n, engine_names[e], us);
+                else
+                    printf("%s,%zu,%s,%d,%.1f\n", cases[c].name, n, engine_names[e], matched, us);
+                fflush(stdout);
+                skip[e] = matched < 0 || us > BENCH_BUDGET * 1e6;
+            }
+        }
+    }
+    return 0;
+}
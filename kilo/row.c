@@ -0,0 +1,266 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "editor.h"
+#include "highlighting.h"
+#include "row.h"
+
+static int reserve(struct row_index *ri, size_t extra) {
+    if (ri->n + extra <= ri->cap)
+        return 0;
+    size_t cap = ri->cap ? ri->cap * 2 : 4;
+    while (cap < ri->n + extra)
+        cap *= 2;
+    struct row_segment *grown = realloc(ri->segs, cap * sizeof(struct row_segment));
+    if (grown == NULL)
+        return -1;
+    ri->segs = grown;
+    ri->cap = cap;
+    return 0;
+}
+
+size_t row_rx_after(char c, size_t rx) {
+    if (c == '\t')
+        rx += (TAB_SIZE - 1) - (rx % TAB_SIZE);
+    return rx + 1;
+}
+
+// Render column after segment s, starting at column rx.
+static size_t segment_rx(const struct row_segment *s, size_t rx) {
+    if (s->tab == s->len)
+        return rx + s->len;
+    rx += s->tab;
+    return rx + TAB_SIZE - rx % TAB_SIZE + s->tail;
+}
+
+// Works out what segment s, whose text starts at text, does to the render column. Past its
+// first tab it starts on a tab stop whatever column it started at.
+static void summarize(struct row_segment *s, const char *text) {
+    const char *tab = memchr(text, '\t', s->len);
+    s->tab = tab ? (size_t) (tab - text) : s->len;
+    size_t rx = 0;
+    for (size_t j = s->tab + 1; j < s->len; j++)
+        rx = row_rx_after(text[j], rx);
+    s->tail = rx;
+}
+
+// The last segment that starts at or before byte at.
+static size_t segment_at(const struct row_index *ri, size_t at) {
+    size_t lo = 0, hi = ri->n;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (ri->segs[mid].start <= at)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// The last segment that starts at or before render column rx.
+static size_t segment_at_rx(const struct row_index *ri, size_t rx) {
+    size_t lo = 0, hi = ri->n;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (ri->segs[mid].rx <= rx)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// Works out again where the segments from i on start, after i or one before it changed.
+static void reindex(struct row_index *ri, size_t i) {
+    size_t start = 0, rx = 0;
+    if (i > 0) {
+        start = ri->segs[i - 1].start + ri->segs[i - 1].len;
+        rx = segment_rx(&ri->segs[i - 1], ri->segs[i - 1].rx);
+    }
+    for (; i < ri->n; i++) {
+        ri->segs[i].start = start;
+        ri->segs[i].rx = rx;
+        start += ri->segs[i].len;
+        rx = segment_rx(&ri->segs[i], rx);
+    }
+}
+
+int row_index_build(struct row_index *ri, const char *chars, size_t len) {
+    size_t n = len ? (len + ROW_SEGMENT - 1) / ROW_SEGMENT : 1;
+    ri->n = 0;
+    if (reserve(ri, n) != 0)
+        return -1;
+    for (size_t i = 0; i < n; i++) {
+        struct row_segment *s = &ri->segs[i];
+        size_t start = i * ROW_SEGMENT;
+        s->len = len - start < ROW_SEGMENT ? len - start : ROW_SEGMENT;
+        s->lex_skip = 0;
+        s->lex_mode = 0;
+        summarize(s, &chars[start]);
+    }
+    ri->n = n;
+    reindex(ri, 0);
+    row_index_invalidate(ri);
+    return 0;
+}
+
+int row_index_insert(struct row_index *ri, const char *chars, size_t at, size_t n) {
+    if (n == 0)
+        return 0;
+    // the segment at is in, the one before if it is where one ends
+    size_t i = at ? segment_at(ri, at - 1) : 0, start = ri->segs[i].start;
+    size_t len = ri->segs[i].len + n;
+    size_t pieces = len >= 2 * ROW_SEGMENT ? (len + ROW_SEGMENT - 1) / ROW_SEGMENT : 1;
+    if (reserve(ri, pieces - 1) != 0)
+        return -1;
+    memmove(&ri->segs[i + pieces], &ri->segs[i + 1], (ri->n - i - 1) * sizeof(struct row_segment));
+    for (size_t k = 0; k < pieces; k++) {
+        struct row_segment *s = &ri->segs[i + k];
+        s->len = k + 1 < pieces ? ROW_SEGMENT : len - k * ROW_SEGMENT;
+        summarize(s, &chars[start + k * ROW_SEGMENT]);
+    }
+    ri->n += pieces - 1;
+    reindex(ri, i);
+
+    size_t from = at, to = at + n;
+    if (pieces > 1) {
+        // the segments it was cut into start where no lexer state was kept
+        from = start;
+        to = start + len;
+    }
+    if (ri->dirty_from == ROW_CLEAN) {
+        ri->dirty_from = from;
+        ri->dirty_to = to;
+        return 0;
+    }
+    if (ri->dirty_to != ROW_CLEAN && ri->dirty_to > at)
+        ri->dirty_to += n;
+    if (ri->dirty_from > from)
+        ri->dirty_from = from;
+    if (ri->dirty_to < to)
+        ri->dirty_to = to;
+    return 0;
+}
+
+void row_index_delete(struct row_index *ri, const char *chars, size_t at, size_t n) {
+    if (n == 0)
+        return;
+    size_t i = segment_at(ri, at), start = ri->segs[i].start;
+    // take the bytes out of the segments they were in, dropping any that are left empty
+    size_t left = n, off = at - start;
+    size_t j = i, kept = i;
+    while (left > 0 && j < ri->n) {
+        struct row_segment s = ri->segs[j++];
+        size_t take = s.len - off < left ? s.len - off : left;
+        s.len -= take;
+        left -= take;
+        off = 0;
+        if (s.len > 0)
+            ri->segs[kept++] = s;
+    }
+    if (kept == 0 && j == ri->n)
+        ri->segs[kept++] = (struct row_segment) { 0 };
+    memmove(&ri->segs[kept], &ri->segs[j], (ri->n - j) * sizeof(struct row_segment));
+    ri->n -= j - kept;
+    for (size_t k = i; k < kept; k++) {
+        summarize(&ri->segs[k], &chars[start]);
+        start += ri->segs[k].len;
+    }
+    reindex(ri, i);
+
+    // the segment that lost its start is not where its lexer state was
+    size_t to = at + 1;
+    if (ri->dirty_from == ROW_CLEAN) {
+        ri->dirty_from = at;
+        ri->dirty_to = to;
+        return;
+    }
+    if (ri->dirty_to != ROW_CLEAN && ri->dirty_to > at)
+        ri->dirty_to = ri->dirty_to > at + n ? ri->dirty_to - n : at;
+    if (ri->dirty_from > at)
+        ri->dirty_from = at;
+    if (ri->dirty_to < to)
+        ri->dirty_to = to;
+}
+
+size_t row_index_cx_to_rx(const struct row_index *ri, const char *chars, size_t cx) {
+    const struct row_segment *s = &ri->segs[segment_at(ri, cx)];
+    if (cx >= s->start + s->len)
+        return segment_rx(s, s->rx);
+    size_t rx = s->rx;
+    for (size_t j = s->start; j < cx; j++)
+        rx = row_rx_after(chars[j], rx);
+    return rx;
+}
+
+size_t row_index_rx_to_cx(const struct row_index *ri, const char *chars, size_t rx, size_t *cx_rx) {
+    const struct row_segment *s = &ri->segs[segment_at_rx(ri, rx)];
+    size_t cur = s->rx, cx = s->start, end = s->start + s->len;
+    // only the last segment can end at or before rx
+    if (segment_rx(s, cur) <= rx) {
+        *cx_rx = segment_rx(s, cur);
+        return end;
+    }
+    for (; cx < end; cx++) {
+        size_t next = row_rx_after(chars[cx], cur);
+        if (next > rx)
+            break;
+        cur = next;
+    }
+    *cx_rx = cur;
+    return cx;
+}
+
+int row_index_lexed(const struct row_index *ri, int in_comment) {
+    return ri->dirty_from == ROW_CLEAN && ri->lex_in == in_comment;
+}
+
+int row_index_lex(struct row_index *ri, const struct editor_syntax *syntax, const char *chars, size_t len, int in_comment) {
+    if (row_index_lexed(ri, in_comment))
+        return ri->lex_out;
+    size_t from = ri->dirty_from, to = ri->dirty_to;
+    if (from == ROW_CLEAN)
+        from = to = 0;
+    if (in_comment != ri->lex_in)
+        from = 0;
+    size_t lookahead = syntax ? syntax->lookahead : 1;
+    // the last segment whose lexer state was worked out from bytes none of which changed
+    size_t b = segment_at(ri, from);
+    while (b > 0 && ri->segs[b].start + ri->segs[b].lex_skip + lookahead > from)
+        b--;
+    size_t pos = b ? ri->segs[b].start + ri->segs[b].lex_skip : 0;
+    unsigned char mode = b ? ri->segs[b].lex_mode : (in_comment ? LEX_MODE_COMMENT : LEX_MODE_SEP);
+    ri->lex_in = in_comment;
+    ri->dirty_from = ri->dirty_to = ROW_CLEAN;
+    for (size_t i = b + 1; i < ri->n; i++) {
+        size_t start = ri->segs[i].start;
+        editor_syntax_lex(syntax, chars, len, &pos, &mode, start, NULL);
+        struct row_segment *s = &ri->segs[i];
+        // past the edits, the same state at the same place means the rest lexes the same
+        if (start >= to && s->lex_skip == pos - start && s->lex_mode == mode)
+            return ri->lex_out;
+        s->lex_skip = pos - start;
+        s->lex_mode = mode;
+    }
+    editor_syntax_lex(syntax, chars, len, &pos, &mode, len, NULL);
+    ri->lex_out = syntax && mode == LEX_MODE_COMMENT;
+    return ri->lex_out;
+}
+
+void row_index_invalidate(struct row_index *ri) {
+    ri->dirty_from = 0;
+    ri->dirty_to = ROW_CLEAN;
+}
+
+void row_index_lex_state(const struct row_index *ri, size_t cx, size_t *pos, unsigned char *mode) {
+    size_t i = segment_at(ri, cx);
+    while (i > 0 && ri->segs[i].start + ri->segs[i].lex_skip > cx)
+        i--;
+    *pos = i ? ri->segs[i].start + ri->segs[i].lex_skip : 0;
+    *mode = i ? ri->segs[i].lex_mode : (ri->lex_in ? LEX_MODE_COMMENT : LEX_MODE_SEP);
+}
+
+void row_index_free(struct row_index *ri) {
+    free(ri->segs);
+    memset(ri, 0, sizeof(*ri));
+}
@@ -0,0 +1,78 @@
+#ifndef __ROW_H
+#define __ROW_H
+
+#include <stddef.h>
+
+/*
+   A row's text cut into segments of about ROW_SEGMENT bytes, so that a long line can be
+   drawn and highlighted a few KB at a time. Every segment knows where it starts, what it
+   does to the render column and the column it starts at, so the column of any byte is a
+   binary search for its segment and a scan of that, and what state the lexer is in where it
+   starts, so highlighting can start at the segment a window of the row begins in. An edit
+   only summarizes its own segment again and adds its length to where the ones after it
+   start, and the lexer goes on from the segment before it only until it is back in the state
+   it was in. The row's bytes stay in one buffer, which an edit still moves the rest of.
+*/
+
+#define ROW_SEGMENT 4096    // bytes a row is cut into; a segment that grows to twice this is cut again
+#define ROW_CLEAN ((size_t) -1)
+
+struct editor_syntax;
+
+struct row_segment {
+    size_t start;    // where it is in the row
+    size_t rx;       // the render column it starts at
+    size_t len;
+    size_t tab;      // bytes before its first tab, len if it has none
+    size_t tail;     // columns from the tab stop after that tab to its end
+    size_t lex_skip; // the lexer state is for the first byte it steps onto from here on,
+    unsigned char lex_mode; // which can be past the start in a keyword or delimiter
+};
+
+struct row_index {
+    struct row_segment *segs; // at least one, maybe empty
+    size_t n;
+    size_t cap;
+    size_t dirty_from; // bytes dirty_from up to dirty_to changed since the row was lexed,
+    size_t dirty_to;   // ROW_CLEAN if none have
+    int lex_in;  // whether the row was lexed starting inside a block comment
+    int lex_out; // and whether it ended in one
+};
+
+// Cuts chars[0..len) into segments, to be lexed by row_index_lex. Returns -1 if malloc fails.
+int row_index_build(struct row_index *ri, const char *chars, size_t len);
+
+// Takes in the n bytes inserted at at, chars being the row with them. Returns -1 if malloc
+// fails.
+int row_index_insert(struct row_index *ri, const char *chars, size_t at, size_t n);
+
+// Takes in the n bytes deleted at at, chars being the row without them.
+void row_index_delete(struct row_index *ri, const char *chars, size_t at, size_t n);
+
+// Render column after the char c at render column rx.
+size_t row_rx_after(char c, size_t rx);
+
+// Render column of byte cx.
+size_t row_index_cx_to_rx(const struct row_index *ri, const char *chars, size_t cx);
+
+// The byte that takes up render column rx (the row's length if none does), and in *cx_rx
+// the column it starts at, which is before rx for a tab.
+size_t row_index_rx_to_cx(const struct row_index *ri, const char *chars, size_t rx, size_t *cx_rx);
+
+// Whether the lexer states are up to date for the row starting in or out of a block comment.
+int row_index_lexed(const struct row_index *ri, int in_comment);
+
+// Brings the lexer states up to date with syntax, from the last segment that no edit since
+// the last time can have changed, until they are what they were again. Returns whether the
+// row ends inside a block comment.
+int row_index_lex(struct row_index *ri, const struct editor_syntax *syntax, const char *chars, size_t len, int in_comment);
+
+// Forgets every lexer state, for when the syntax changes.
+void row_index_invalidate(struct row_index *ri);
+
+// Where to start the lexer to highlight from byte cx: a byte at or before it in *pos and the
+// lexer's mode there in *mode. The row has to have been lexed.
+void row_index_lex_state(const struct row_index *ri, size_t cx, size_t *pos, unsigned char *mode);
+
+void row_index_free(struct row_index *ri);
+#endif
@@ -0,0 +1,190 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "editor.h"
+#include "screen.h"
+#include "termutils.h"
+
+static const struct cell blank = { ' ', CELL_DEFAULT_COLOR, 0 };
+
+#define CELL_EQUAL(a, b) ((a).ch == (b).ch && (a).color == (b).color && (a).style == (b).style)
+
+int screen_resize(struct screen *screen, size_t rows, size_t cols) {
+    if (screen->cells && screen->rows == rows && screen->cols == cols)
+        return 0;
+    struct cell *cells = realloc(screen->cells, rows * cols * sizeof(struct cell));
+    if (cells == NULL)
+        return -1;
+    screen->cells = cells;
+    struct cell *shadow = realloc(screen->shadow, rows * cols * sizeof(struct cell));
+    if (shadow == NULL)
+        return -1;
+    screen->shadow = shadow;
+    struct cell *blank_row = realloc(screen->blank_row, cols * sizeof(struct cell));
+    if (blank_row == NULL)
+        return -1;
+    screen->blank_row = blank_row;
+    size_t *row_end = realloc(screen->row_end, rows * sizeof(size_t));
+    if (row_end == NULL)
+        return -1;
+    screen->row_end = row_end;
+    unsigned char *row_wide = realloc(screen->row_wide, rows * 2);
+    if (row_wide == NULL)
+        return -1;
+    screen->row_wide = row_wide;
+    for (size_t x = 0; x < cols; x++) blank_row[x] = blank;
+    screen->rows = rows;
+    screen->cols = cols;
+    for (size_t y = 0; y < rows; y++) screen_end_row(screen, y, 0);
+    screen->shadow_valid = 0;
+    // a full frame is every cell plus a few escapes per row
+    screen->out.len = 0;
+    if (ab_reserve(&screen->out, rows * (cols + SCREEN_ROW_ESCAPES)) != 0)
+        return -1;
+    return 0;
+}
+
+struct cell *screen_row(struct screen *screen, size_t y) {
+    return &screen->cells[y * screen->cols];
+}
+
+void screen_end_row(struct screen *screen, size_t y, size_t x) {
+    if (x > screen->cols)
+        x = screen->cols;
+    struct cell *cells = screen_row(screen, y);
+    memcpy(&cells[x], screen->blank_row, (screen->cols - x) * sizeof(struct cell));
+    // a row with bytes the terminal may draw as fewer columns than cells (UTF-8) can't be
+    // patched in the middle, since its cells no longer line up with the columns
+    int wide = 0;
+    for (size_t i = 0; i < x; i++) wide |= cells[i].ch;
+    screen->row_end[y] = x;
+    screen->row_wide[y] = wide & 0x80;
+}
+
+// What the terminal is drawing with right now; style 0xff means unknown.
+struct sgr {
+    unsigned char color;
+    unsigned char style;
+};
+
+static void set_sgr(struct abuf *ab, struct sgr *current, unsigned char color, unsigned char style) {
+    char buf[32];
+    int len;
+    if (current->style != style) {
+        // attributes can only be turned off all at once
+        len = snprintf(buf, sizeof(buf), "\x1b[0%s%s", (style & CELL_BOLD) ? ";1" : "", (style & CELL_REVERSE) ? ";7" : "");
+        if (color != CELL_DEFAULT_COLOR)
+            len += snprintf(&buf[len], sizeof(buf) - len, ";%d", color);
+        buf[len++] = 'm';
+    }
+    else if (current->color != color) {
+        len = snprintf(buf, sizeof(buf), "\x1b[%dm", color);
+    }
+    else {
+        return;
+    }
+    ab_append(ab, buf, len);
+    current->color = color;
+    current->style = style;
+}
+
+static void move_to(struct abuf *ab, size_t y, size_t x) {
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), "\x1b[%zu;%zuH", y + 1, x + 1);
+    ab_append(ab, buf, len);
+}
+
+// Writes n cells, one SGR and one copy per run of cells drawn the same way.
+static void emit_span(struct abuf *ab, struct sgr *current, const struct cell *cells, size_t n) {
+    size_t i = 0;
+    while (i < n) {
+        size_t run = i + 1;
+        while (run < n && cells[run].color == cells[i].color && cells[run].style == cells[i].style) run++;
+        set_sgr(ab, current, cells[i].color, cells[i].style);
+        if (ab_reserve(ab, run - i) != 0)
+            return;
+        char *out = &ab->b[ab->len];
+        for (size_t j = i; j < run; j++) *out++ = cells[j].ch;
+        ab->len += run - i;
+        i = run;
+    }
+}
+
+void screen_flush(struct screen *screen, struct abuf *ab) {
+    struct sgr current = { CELL_DEFAULT_COLOR, 0xff };
+    size_t cols = screen->cols;
+    unsigned char *shadow_wide = &screen->row_wide[screen->rows];
+    if (!screen->shadow_valid) {
+        set_sgr(ab, &current, CELL_DEFAULT_COLOR, 0);
+        ab_append(ab, "\x1b[2J", 4);
+        for (size_t y = 0; y < screen->rows; y++)
+            memcpy(&screen->shadow[y * cols], screen->blank_row, cols * sizeof(struct cell));
+        memset(shadow_wide, 0, screen->rows);
+        screen->shadow_valid = 1;
+    }
+    for (size_t y = 0; y < screen->rows; y++) {
+        struct cell *new = &screen->cells[y * cols];
+        struct cell *old = &screen->shadow[y * cols];
+        if (memcmp(new, old, cols * sizeof(struct cell)) == 0)
+            continue;
+        size_t end = screen->row_end[y]; // the new row is blank from here on
+        int whole = screen->row_wide[y] || shadow_wide[y];
+        size_t at = 0; // where the cursor is
+        int moved = 0;
+
+        size_t x = 0;
+        while (x < end) {
+            if (!whole && CELL_EQUAL(new[x], old[x])) {
+                x++;
+                continue;
+            }
+            move_to(ab, y, x);
+            size_t span_end = whole ? end : x;
+            while (span_end < end) {
+                // take in a short run of unchanged cells if there is another change after it
+                size_t gap = 0;
+                while (span_end + gap < end && gap < SCREEN_GAP && CELL_EQUAL(new[span_end + gap], old[span_end + gap]))
+                    gap++;
+                if (gap == SCREEN_GAP || span_end + gap == end)
+                    break;
+                span_end += gap + 1;
+            }
+            emit_span(ab, &current, &new[x], span_end - x);
+            x = at = span_end;
+            moved = 1;
+        }
+        if (whole) {
+            // the terminal's cursor is wherever the bytes took it, which may be short of end,
+            // so anything after them is erased
+            if (!moved)
+                move_to(ab, y, 0);
+            if (end < cols || screen->row_wide[y]) {
+                set_sgr(ab, &current, CELL_DEFAULT_COLOR, 0);
+                ab_append(ab, "\x1b[K", 3);
+            }
+        }
+        else if (end < cols && memcmp(&new[end], &old[end], (cols - end) * sizeof(struct cell)) != 0) {
+            if (!moved || at != end)
+                move_to(ab, y, end);
+            set_sgr(ab, &current, CELL_DEFAULT_COLOR, 0);
+            ab_append(ab, "\x1b[K", 3);
+        }
+        memcpy(old, new, cols * sizeof(struct cell));
+        shadow_wide[y] = screen->row_wide[y];
+    }
+    set_sgr(ab, &current, CELL_DEFAULT_COLOR, 0);
+}
+
+void screen_invalidate(struct screen *screen) {
+    screen->shadow_valid = 0;
+}
+
+void screen_free(struct screen *screen) {
+    free(screen->cells);
+    free(screen->shadow);
+    free(screen->blank_row);
+    free(screen->row_end);
+    free(screen->row_wide);
+    ab_free(&screen->out);
+    memset(screen, 0, sizeof(*screen));
+}
@@ -0,0 +1,68 @@
+#ifndef __SCREEN_H
+#define __SCREEN_H
+
+#include <stddef.h>
+
+#define CELL_DEFAULT_COLOR 39
+#define CELL_BOLD (1 << 0)
+#define CELL_REVERSE (1 << 1)
+#define SCREEN_GAP 8 // unchanged cells between two changes cheaper to rewrite than to jump over
+#define SCREEN_ROW_ESCAPES 64 // output reserved per row on top of its cells
+
+#define ABUF_INIT \
+    {             \
+        NULL, 0, 0 \
+    }
+#define ABUF_INITIAL 4096
+
+// Output is appended here and written in one go. It only ever grows, so one that is
+// reused stops reallocating once it has held the biggest frame.
+struct abuf
+{
+    char *b;
+    int len;
+    int cap;
+};
+
+// One character on the terminal: the byte and the SGR it is drawn with.
+struct cell {
+    char ch;
+    unsigned char color; // foreground SGR code, CELL_DEFAULT_COLOR for none
+    unsigned char style; // CELL_* bits
+};
+
+// The frame being drawn and a shadow of what the terminal shows now. screen_flush only
+// sends the cells that differ between the two.
+struct screen {
+    size_t rows;
+    size_t cols;
+    struct cell *cells;
+    struct cell *shadow;
+    struct cell *blank_row; // cols blanks to clear rows with
+    size_t *row_end;        // per row of cells: where its blank tail starts
+    unsigned char *row_wide; // per row of cells, then of shadow: whether it has bytes >= 0x80
+    int shadow_valid; // 0 until the terminal has been cleared to match the shadow
+    struct abuf out;  // every frame's output, reused
+};
+
+// Makes the screen rows x cols. Changing the size clears it, so the next flush redraws
+// everything, and sizes out for a full frame. Returns -1 if malloc fails.
+int screen_resize(struct screen *screen, size_t rows, size_t cols);
+
+// Cells of row y of the frame being drawn.
+struct cell *screen_row(struct screen *screen, size_t y);
+
+// Ends row y at column x: the cells from x on are blanked. Every row of a frame has to
+// be ended once its cells are written.
+void screen_end_row(struct screen *screen, size_t y, size_t x);
+
+// Appends what it takes to turn the terminal's contents into the new frame to ab, and
+// remembers the new frame as what the terminal shows. Leaves the SGR reset and the cursor
+// somewhere on the screen.
+void screen_flush(struct screen *screen, struct abuf *ab);
+
+// Forgets what the terminal shows, e.g. after something else wrote to it.
+void screen_invalidate(struct screen *screen);
+
+void screen_free(struct screen *screen);
+#endif
@@ -0,0 +1,782 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "search.h"
+
+enum chunk_state {
+    CHUNK_TODO,
+    CHUNK_TAKEN, // a worker is on it
+    CHUNK_DONE,
+};
+
+// A stretch of the document and the matches that start in it. All of those before scanned
+// have been found. A regex's chunks go from the start of a line to the start of another.
+struct search_chunk {
+    size_t begin;
+    size_t end;
+    size_t scanned;
+    size_t *matches;
+    size_t n_matches;
+    size_t matches_cap;
+    enum chunk_state state;
+};
+
+struct search_worker {
+    struct search_pool *pool;
+    struct regex regex; // its own, as matching builds the DFA as it goes
+    int has_regex;
+    size_t *found; // matches not handed over to the chunk yet
+    size_t n_found;
+    size_t found_cap;
+    char *seam;
+    char *line; // lines that span pieces, copied out of them
+    size_t line_cap;
+};
+
+// Threads that take the chunks in order and search them. Everything from chunks on is
+// guarded by lock, and changed is signalled whenever any of it changes.
+struct search_pool {
+    const struct piece_table *doc; // mustn't change while the workers run
+    char *query; // its own copy, as a retired pool's workers can outlive the search's
+    size_t query_len;
+    int regex;
+    struct search_chunk *chunks;
+    size_t n_chunks;
+    size_t next_chunk; // where the workers look for one to take
+    size_t found;      // matches in all the chunks
+    size_t limit;      // the workers stop once there are this many
+    int cancel;
+    int failed; // a worker's malloc failed
+    int running;
+    unsigned long gen;  // goes up with every change to the chunks
+    unsigned long seen; // gen when search_poll last looked
+    int wake[2];        // a byte is written to wake[1] when gen goes past seen, see search_fd
+    int woken;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    struct search_worker workers[SEARCH_MAX_WORKERS];
+    int n_workers;
+    pthread_t threads[SEARCH_MAX_WORKERS];
+    int n_threads;
+    struct search_pool *next; // in search->retired
+};
+
+// Reads the document at increasing positions without looking for the piece from the
+// start every time.
+struct doc_reader {
+    const struct piece_table *pt;
+    size_t piece;
+    size_t piece_start; // document offset of piece
+};
+
+static size_t doc_read(struct doc_reader *r, size_t pos, size_t len, char *out) {
+    const struct piece_table *pt = r->pt;
+    while (r->piece < pt->n_pieces && pos >= r->piece_start + pt->pieces[r->piece].len) {
+        r->piece_start += pt->pieces[r->piece].len;
+        r->piece++;
+    }
+    size_t copied = 0;
+    size_t i = r->piece;
+    size_t off = pos - r->piece_start;
+    while (copied < len && i < pt->n_pieces) {
+        size_t n = pt->pieces[i].len - off;
+        if (n > len - copied)
+            n = len - copied;
+        memcpy(&out[copied], piece_table_piece_data(pt, i) + off, n);
+        copied += n;
+        off = 0;
+        i++;
+    }
+    return copied;
+}
+
+// The text of the piece that pos is in, from pos on; *len is how much of it there is.
+static const char *doc_at(struct doc_reader *r, size_t pos, size_t *len) {
+    const struct piece_table *pt = r->pt;
+    while (pos >= r->piece_start + pt->pieces[r->piece].len) {
+        r->piece_start += pt->pieces[r->piece].len;
+        r->piece++;
+    }
+    size_t off = pos - r->piece_start;
+    *len = pt->pieces[r->piece].len - off;
+    return piece_table_piece_data(pt, r->piece) + off;
+}
+
+// Offset of the first place at or after from and before end that q occurs, or end. The
+// pieces are looked through with memmem, which glibc does with a shift table over pairs of
+// bytes and the two-way algorithm for long needles, and where one piece ends the bytes on
+// both sides go in seam, which has room for 2 * qlen, to find any that cross over.
+static size_t find_next(struct doc_reader *r, size_t from, size_t end, const char *q, size_t qlen, char *seam) {
+    while (from < end) {
+        size_t len;
+        const char *data = doc_at(r, from, &len);
+        // a match that starts before end may run on qlen - 1 bytes past it
+        size_t span = len < end - from + qlen - 1 ? len : end - from + qlen - 1;
+        const char *hit = memmem(data, span, q, qlen);
+        if (hit)
+            return from + (hit - data);
+        size_t next = from + len;
+        if (qlen > 1 && next < end) {
+            size_t head = len < qlen - 1 ? len : qlen - 1;
+            memcpy(seam, data + len - head, head);
+            // read ahead with a copy, as a match found here starts before next
+            struct doc_reader ahead = *r;
+            size_t tail = doc_read(&ahead, next, qlen - 1, &seam[head]);
+            if ((hit = memmem(seam, head + tail, q, qlen)))
+                return next - head + (hit - seam);
+        }
+        from = next;
+    }
+    return end;
+}
+
+static int cancelled(struct search_pool *pool) {
+    return __atomic_load_n(&pool->cancel, __ATOMIC_RELAXED);
+}
+
+static int add_found(struct search_worker *w, size_t pos) {
+    if (w->n_found == w->found_cap) {
+        size_t cap = w->found_cap ? w->found_cap * 2 : SEARCH_BATCH;
+        size_t *found = realloc(w->found, cap * sizeof(size_t));
+        if (found == NULL)
+            return -1;
+        w->found = found;
+        w->found_cap = cap;
+    }
+    w->found[w->n_found++] = pos;
+    return 0;
+}
+
+// Tells whoever waits on the pool, a worker or the editor's poll(), that the chunks have
+// changed. Called with the lock held.
+static void notify(struct search_pool *pool) {
+    pool->gen++;
+    pthread_cond_broadcast(&pool->changed);
+    if (!pool->woken)
+        pool->woken = write(pool->wake[1], "", 1) == 1;
+}
+
+// Adds what the worker has found to c, which it has now searched up to scanned. Returns 1
+// if the workers are to stop, 0 if not and -1 if malloc fails.
+static int hand_over(struct search_worker *w, struct search_chunk *c, size_t scanned) {
+    struct search_pool *pool = w->pool;
+    pthread_mutex_lock(&pool->lock);
+    if (c->n_matches + w->n_found > c->matches_cap) {
+        size_t cap = c->matches_cap ? c->matches_cap : SEARCH_BATCH;
+        while (cap < c->n_matches + w->n_found)
+            cap *= 2;
+        size_t *matches = realloc(c->matches, cap * sizeof(size_t));
+        if (matches == NULL) {
+            pthread_mutex_unlock(&pool->lock);
+            return -1;
+        }
+        c->matches = matches;
+        c->matches_cap = cap;
+    }
+    memcpy(&c->matches[c->n_matches], w->found, w->n_found * sizeof(size_t));
+    c->n_matches += w->n_found;
+    c->scanned = scanned;
+    pool->found += w->n_found;
+    if (w->n_found)
+        notify(pool);
+    w->n_found = 0;
+    int stop = pool->cancel || pool->found >= pool->limit;
+    pthread_mutex_unlock(&pool->lock);
+    return stop;
+}
+
+// Whether the worker should hand over what it has: a chunk's first match goes at once, so
+// that it can be shown, and the rest SEARCH_BATCH at a time.
+static int due(struct search_worker *w, struct search_chunk *c) {
+    return w->n_found >= SEARCH_BATCH || (w->n_found && c->n_matches == 0) || cancelled(w->pool);
+}
+
+// Where the worker searching from pos in c next looks at whether to stop.
+static size_t step_end(struct search_chunk *c, size_t pos) {
+    return c->end - pos > SEARCH_STEP ? pos + SEARCH_STEP : c->end;
+}
+
+// Finds the literal query in c from where it got to, SEARCH_STEP bytes at a time so that
+// the workers stop soon after being told to even where nothing matches. Returns 0 at the
+// end of c, 1 if the workers are to stop before it and -1 if malloc fails.
+static int scan_chunk(struct search_worker *w, struct search_chunk *c) {
+    struct search_pool *pool = w->pool;
+    struct doc_reader reader = { pool->doc, 0, 0 };
+    size_t pos = c->scanned;
+    int stop;
+    while (pos < c->end) {
+        size_t end = step_end(c, pos);
+        while ((pos = find_next(&reader, pos, end, pool->query, pool->query_len, w->seam)) < end) {
+            if (add_found(w, pos) != 0)
+                return -1;
+            pos++;
+            if (due(w, c) && (stop = hand_over(w, c, pos)) != 0)
+                return stop;
+        }
+        if (pos < c->end && cancelled(pool) && (stop = hand_over(w, c, pos)) != 0)
+            return stop;
+    }
+    return hand_over(w, c, c->end) < 0 ? -1 : 0;
+}
+
+struct line_matches {
+    struct search_worker *w;
+    size_t start; // document offset of the line
+    int failed;
+};
+
+static int add_line_match(void *arg, size_t start, size_t end) {
+    struct line_matches *lm = arg;
+    (void) end;
+    if (add_found(lm->w, lm->start + start) != 0) {
+        lm->failed = 1;
+        return 1;
+    }
+    return 0;
+}
+
+// A line can be the whole document, so the workers stop in the middle of one.
+static int line_cancelled(void *arg) {
+    struct line_matches *lm = arg;
+    return cancelled(lm->w->pool);
+}
+
+// Adds the regex's matches in the line that pos is on and sets *next to where the next
+// line starts. A line that is all in the piece r is at is matched where it is; one that
+// isn't is found with the line index and copied out of the pieces. Returns -1 if malloc
+// fails, or 1 if the workers were told to stop part way along the line, in which case none
+// of its matches are kept and *next is where it starts, to match it again from there.
+static int add_line(struct search_worker *w, struct doc_reader *r, size_t pos, size_t *next) {
+    const struct piece_table *pt = r->pt;
+    size_t after;
+    const char *at = doc_at(r, pos, &after);
+    const char *piece = at - (pos - r->piece_start);
+    const char *start = memrchr(piece, '\n', at - piece);
+    const char *end = memchr(at, '\n', after);
+    start = start ? start + 1 : r->piece_start == 0 ? piece : NULL;
+    if (end == NULL && pos + after == pt->len)
+        end = at + after;
+    const char *line;
+    size_t line_start, len;
+    if (start && end) {
+        line = start;
+        line_start = pos - (at - start);
+        len = end - start;
+        *next = pos + (end - at) + (end < at + after);
+    }
+    else {
+        size_t n = piece_table_line_at(pt, pos);
+        line_start = piece_table_line_offset(pt, n);
+        len = piece_table_line_offset(pt, n + 1) - line_start;
+        *next = line_start + len;
+        if (len > w->line_cap) {
+            char *grown = realloc(w->line, len);
+            if (grown == NULL)
+                return -1;
+            w->line = grown;
+            w->line_cap = len;
+        }
+        piece_table_read(pt, line_start, len, w->line);
+        if (len && w->line[len - 1] == '\n')
+            len--;
+        line = w->line;
+    }
+    size_t had = w->n_found;
+    struct line_matches lm = { w, line_start, 0 };
+    int stop = regex_line_matches(&w->regex, line, len, add_line_match, line_cancelled, &lm);
+    if (stop < 0 || lm.failed)
+        return -1;
+    if (stop > 0) {
+        w->n_found = had;
+        *next = line_start;
+        return 1;
+    }
+    return 0;
+}
+
+// Finds the regex in c from where it got to, the way scan_chunk does a literal. The DFA is
+// run along each piece in turn, carrying its state over the seams, to find the lines with
+// a match; only in those are the matches themselves looked for. If every match has a long
+// enough literal in it, only lines where memmem finds that are looked at.
+static int scan_regex_chunk(struct search_worker *w, struct search_chunk *c) {
+    const struct piece_table *pt = w->pool->doc;
+    struct regex *re = &w->regex;
+    struct doc_reader reader = { pt, 0, 0 };
+    size_t pos = c->scanned;
+    int stop, r;
+    if (re->literal_len >= SEARCH_LITERAL_MIN) {
+        char seam[2 * REGEX_LITERAL_MAX];
+        while (pos < c->end) {
+            // a line with a match has the literal at or after any point in it not yet passed,
+            // so this can stop and go on from the middle of one
+            size_t end = step_end(c, pos);
+            size_t hit = find_next(&reader, pos, end, re->literal, re->literal_len, seam);
+            if (hit == end)
+                pos = end;
+            else if ((r = add_line(w, &reader, hit, &pos)) != 0)
+                return r < 0 || hand_over(w, c, pos) < 0 ? -1 : 1;
+            if (pos < c->end && due(w, c) && (stop = hand_over(w, c, pos)) != 0)
+                return stop;
+        }
+        return hand_over(w, c, c->end) < 0 ? -1 : 0;
+    }
+    int state = REGEX_LINE_START;
+    while (pos < c->end) {
+        size_t len, used;
+        const char *text = doc_at(&reader, pos, &len);
+        if (len > step_end(c, pos) - pos)
+            len = step_end(c, pos) - pos;
+        int found = regex_scan(re, &state, text, len, &used);
+        if (found < 0)
+            return -1;
+        pos += used;
+        if (found) {
+            if ((r = add_line(w, &reader, pos - 1, &pos)) != 0)
+                return r < 0 || hand_over(w, c, pos) < 0 ? -1 : 1;
+            state = REGEX_LINE_START;
+        }
+        if (pos < c->end && due(w, c)) {
+            // the scan can only be taken up again where a line starts
+            size_t line = state == REGEX_LINE_START ? pos : piece_table_line_offset(pt, piece_table_line_at(pt, pos));
+            if ((stop = hand_over(w, c, line)) != 0)
+                return stop;
+        }
+    }
+    // the last line has no newline to end it
+    if (c->end == pt->len && pos > 0 && regex_scan_end(re, state) && (r = add_line(w, &reader, pos - 1, &pos)) != 0)
+        return r < 0 || hand_over(w, c, pos) < 0 ? -1 : 1;
+    return hand_over(w, c, c->end) < 0 ? -1 : 0;
+}
+
+static void *search_work(void *arg) {
+    struct search_worker *w = arg;
+    struct search_pool *pool = w->pool;
+    pthread_mutex_lock(&pool->lock);
+    while (!pool->cancel && !pool->failed && pool->found < pool->limit) {
+        while (pool->next_chunk < pool->n_chunks && pool->chunks[pool->next_chunk].state != CHUNK_TODO)
+            pool->next_chunk++;
+        if (pool->next_chunk == pool->n_chunks)
+            break;
+        struct search_chunk *c = &pool->chunks[pool->next_chunk++];
+        c->state = CHUNK_TAKEN;
+        pthread_mutex_unlock(&pool->lock);
+        w->n_found = 0;
+        int r = pool->regex ? scan_regex_chunk(w, c) : scan_chunk(w, c);
+        pthread_mutex_lock(&pool->lock);
+        if (r < 0)
+            pool->failed = 1;
+        // a chunk left part way is taken up again from scanned
+        c->state = r == 0 ? CHUNK_DONE : CHUNK_TODO;
+        notify(pool);
+    }
+    pool->running--;
+    pthread_cond_broadcast(&pool->changed);
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+// Stops the workers and waits for them to finish, leaving each chunk where they got to.
+static void pool_stop(struct search_pool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    __atomic_store_n(&pool->cancel, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&pool->lock);
+    for (int t = 0; t < pool->n_threads; t++)
+        pthread_join(pool->threads[t], NULL);
+    pool->n_threads = 0;
+    for (int t = 0; t < pool->n_workers; t++) {
+        struct search_worker *w = &pool->workers[t];
+        if (w->has_regex)
+            regex_free(&w->regex);
+        free(w->found);
+        free(w->seam);
+        free(w->line);
+        memset(w, 0, sizeof(*w));
+    }
+    pool->n_workers = 0;
+}
+
+static void pool_free(struct search_pool *pool) {
+    if (pool == NULL)
+        return;
+    pool_stop(pool);
+    for (size_t i = 0; i < pool->n_chunks; i++)
+        free(pool->chunks[i].matches);
+    free(pool->chunks);
+    free(pool->query);
+    close(pool->wake[0]);
+    close(pool->wake[1]);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->changed);
+    free(pool);
+}
+
+// Tells the workers to stop without waiting for them, so a key that starts a new search
+// never waits on the last one; pool_reap frees the pool once they have stopped.
+static void pool_retire(struct search *search, struct search_pool *pool) {
+    if (pool == NULL)
+        return;
+    pthread_mutex_lock(&pool->lock);
+    __atomic_store_n(&pool->cancel, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&pool->lock);
+    pool->next = search->retired;
+    search->retired = pool;
+}
+
+// Frees the retired pools whose workers have all stopped, or every one of them, waiting
+// for their workers, if wait is set.
+static void pool_reap(struct search *search, int wait) {
+    struct search_pool **link = &search->retired;
+    while (*link) {
+        struct search_pool *pool = *link;
+        pthread_mutex_lock(&pool->lock);
+        int running = pool->running;
+        pthread_mutex_unlock(&pool->lock);
+        if (running && !wait) {
+            link = &pool->next;
+            continue;
+        }
+        *link = pool->next;
+        pool_free(pool);
+    }
+}
+
+// Takes over from's chunks and what has been found in them, telling its workers to stop
+// first so that it all holds still. Returns -1 if malloc fails.
+static int pool_copy_chunks(struct search_pool *pool, struct search_pool *from) {
+    int failed = 0;
+    pthread_mutex_lock(&from->lock);
+    __atomic_store_n(&from->cancel, 1, __ATOMIC_RELAXED);
+    for (size_t i = 0; i < from->n_chunks && !failed; i++) {
+        struct search_chunk *c = &pool->chunks[pool->n_chunks++];
+        *c = from->chunks[i];
+        c->matches = NULL;
+        c->matches_cap = 0;
+        if (c->n_matches && (c->matches = malloc(c->n_matches * sizeof(size_t))) == NULL) {
+            c->n_matches = 0;
+            failed = 1;
+            break;
+        }
+        memcpy(c->matches, from->chunks[i].matches, c->n_matches * sizeof(size_t));
+        c->matches_cap = c->n_matches;
+        // a chunk a worker was on goes on from where it had handed over
+        if (c->state == CHUNK_TAKEN)
+            c->state = CHUNK_TODO;
+    }
+    pool->found = from->found;
+    pthread_mutex_unlock(&from->lock);
+    // what was found is new to search_poll
+    pool->gen++;
+    return failed ? -1 : 0;
+}
+
+// Splits doc into chunks of about SEARCH_CHUNK bytes, or if from is set takes over its
+// chunks, to go on from where its workers got to. A literal's chunks end anywhere, as a
+// match that starts in one is found by reading up to query_len - 1 bytes past its end, so
+// even a document that is one long line is searched on every core. Returns NULL if malloc
+// fails.
+static struct search_pool *pool_new(const struct piece_table *doc, const char *query, size_t query_len, int regex,
+                                    struct search_pool *from) {
+    struct search_pool *pool = calloc(1, sizeof(struct search_pool));
+    if (pool == NULL)
+        return NULL;
+    pool->chunks = calloc(from ? from->n_chunks + 1 : doc->len / SEARCH_CHUNK + 1, sizeof(struct search_chunk));
+    pool->query = strdup(query);
+    if (pool->chunks == NULL || pool->query == NULL || pipe2(pool->wake, O_NONBLOCK | O_CLOEXEC) != 0) {
+        free(pool->chunks);
+        free(pool->query);
+        free(pool);
+        return NULL;
+    }
+    pool->doc = doc;
+    pool->query_len = query_len;
+    pool->regex = regex;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->changed, NULL);
+    if (from) {
+        if (pool_copy_chunks(pool, from) != 0) {
+            pool_free(pool);
+            return NULL;
+        }
+        return pool;
+    }
+    size_t begin = 0;
+    while (begin < doc->len) {
+        size_t end = begin + SEARCH_CHUNK;
+        // a regex's chunks end where a line starts, so its matches are each in one of them
+        if (end >= doc->len)
+            end = doc->len;
+        else if (regex)
+            end = piece_table_line_offset(doc, piece_table_line_at(doc, end) + 1);
+        struct search_chunk *c = &pool->chunks[pool->n_chunks++];
+        c->begin = c->scanned = begin;
+        c->end = end;
+        begin = end;
+    }
+    return pool;
+}
+
+// Starts a worker per core, and no more than there are chunks left, to search the chunks
+// that aren't done in order. If no thread can be started, the calling thread searches them
+// itself. Returns -1 if malloc fails.
+static int pool_start(struct search_pool *pool) {
+    size_t todo = 0;
+    for (size_t i = 0; i < pool->n_chunks; i++)
+        todo += pool->chunks[i].state != CHUNK_DONE;
+    long workers = sysconf(_SC_NPROCESSORS_ONLN);
+    if (workers > SEARCH_MAX_WORKERS)
+        workers = SEARCH_MAX_WORKERS;
+    if ((size_t) workers > todo)
+        workers = todo;
+    if (workers < 1)
+        workers = todo ? 1 : 0;
+    pool->cancel = 0;
+    pool->next_chunk = 0;
+    for (; pool->n_workers < workers; pool->n_workers++) {
+        struct search_worker *w = &pool->workers[pool->n_workers];
+        w->pool = pool;
+        if (pool->regex) {
+            if (regex_compile(&w->regex, pool->query) != 0)
+                return -1;
+            w->has_regex = 1;
+        }
+        else if ((w->seam = malloc(2 * pool->query_len)) == NULL) {
+            return -1;
+        }
+    }
+    pool->running = workers;
+    while (pool->n_threads < workers &&
+           pthread_create(&pool->threads[pool->n_threads], NULL, search_work, &pool->workers[pool->n_threads]) == 0)
+        pool->n_threads++;
+    if (workers && pool->n_threads == 0) {
+        pool->running = 1;
+        search_work(&pool->workers[0]);
+    }
+    else {
+        // the workers that couldn't be started were never running
+        pthread_mutex_lock(&pool->lock);
+        pool->running -= workers - pool->n_threads;
+        pthread_mutex_unlock(&pool->lock);
+    }
+    return 0;
+}
+
+// Whether the first match so far is also the first in the document, that is, every chunk
+// before the one it's in has been searched, or no chunk has matches and all are done.
+static int leading(struct search_pool *pool) {
+    for (size_t i = 0; i < pool->n_chunks; i++) {
+        if (pool->chunks[i].n_matches)
+            return 1;
+        if (pool->chunks[i].state != CHUNK_DONE)
+            return 0;
+    }
+    return 1;
+}
+
+// Waits up to SEARCH_WAIT_MS for there to be more than before matches with the first of
+// them known, or for the workers to finish.
+static void pool_wait(struct search_pool *pool, size_t before) {
+    struct timespec until;
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_nsec += SEARCH_WAIT_MS * 1000000L;
+    if (until.tv_nsec >= 1000000000L) {
+        until.tv_sec++;
+        until.tv_nsec -= 1000000000L;
+    }
+    pthread_mutex_lock(&pool->lock);
+    while (pool->running > 0 && !(pool->found > before && leading(pool)))
+        if (pthread_cond_timedwait(&pool->changed, &pool->lock, &until) == ETIMEDOUT)
+            break;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Keeps the matches of the last query that the longer one also matches at. Every match of
+// the longer query before where a chunk was searched to is one of those.
+static int refine(struct search *search, const struct piece_table *pt) {
+    struct search_pool *pool = search->pool;
+    char *buf = malloc(search->query_len);
+    if (buf == NULL)
+        return -1;
+    struct doc_reader reader = { pt, 0, 0 };
+    pool->found = 0;
+    for (size_t i = 0; i < pool->n_chunks; i++) {
+        struct search_chunk *c = &pool->chunks[i];
+        size_t kept = 0;
+        for (size_t j = 0; j < c->n_matches; j++) {
+            size_t pos = c->matches[j];
+            if (doc_read(&reader, pos, search->query_len, buf) == search->query_len &&
+                memcmp(buf, search->query, search->query_len) == 0)
+                c->matches[kept++] = pos;
+        }
+        c->n_matches = kept;
+        pool->found += kept;
+    }
+    pool->gen++;
+    free(buf);
+    return 0;
+}
+
+int search_update(struct search *search, const struct piece_table *doc, const char *query, int regex) {
+    size_t len = strlen(query);
+    if (len == 0) {
+        search_free(search);
+        return 0;
+    }
+    // a longer pattern can match where a shorter one didn't, so only literals are refined
+    int extends = !regex && search->pool && !search->regex && len > search->query_len &&
+                  memcmp(query, search->query, search->query_len) == 0;
+    char *copy = strdup(query);
+    if (copy == NULL)
+        return -1;
+    pool_reap(search, 0);
+    free(search->query);
+    search->query = copy;
+    search->query_len = len;
+    search->n_matches = 0;
+    search->current = 0;
+    search->complete = 0;
+    // the workers are only ever looking for the latest query
+    if (extends) {
+        struct search_pool *pool = pool_new(doc, query, len, 0, search->pool);
+        if (pool == NULL)
+            return -1;
+        pool_retire(search, search->pool);
+        search->pool = pool;
+        if (refine(search, doc) != 0)
+            return -1;
+    }
+    else {
+        pool_retire(search, search->pool);
+        search->pool = NULL;
+        search->bad_pattern = 0;
+        if (search->regex) {
+            regex_free(search->regex);
+            free(search->regex);
+            search->regex = NULL;
+        }
+        if (regex) {
+            search->regex = malloc(sizeof(struct regex));
+            if (search->regex == NULL)
+                return -1;
+            if (regex_compile(search->regex, query) != 0) {
+                free(search->regex);
+                search->regex = NULL;
+                search->bad_pattern = 1;
+                search->complete = 1;
+                return 0;
+            }
+        }
+        search->pool = pool_new(doc, query, len, regex, NULL);
+        if (search->pool == NULL)
+            return -1;
+    }
+    search->pool->limit = SEARCH_MAX_MATCHES;
+    if (pool_start(search->pool) != 0)
+        return -1;
+    pool_wait(search->pool, 0);
+    return search_poll(search) < 0 ? -1 : 0;
+}
+
+int search_pending(struct search *search) {
+    struct search_pool *pool = search->pool;
+    if (pool == NULL)
+        return 0;
+    pthread_mutex_lock(&pool->lock);
+    int pending = pool->gen != pool->seen || pool->failed;
+    pthread_mutex_unlock(&pool->lock);
+    return pending;
+}
+
+int search_fd(struct search *search) {
+    return search->pool ? search->pool->wake[0] : -1;
+}
+
+int search_poll(struct search *search) {
+    struct search_pool *pool = search->pool;
+    if (pool == NULL)
+        return 0;
+    pthread_mutex_lock(&pool->lock);
+    if (pool->failed || pool->gen == pool->seen) {
+        pthread_mutex_unlock(&pool->lock);
+        return pool->failed ? -1 : 0;
+    }
+    if (pool->found > search->matches_cap) {
+        size_t *matches = realloc(search->matches, pool->found * sizeof(size_t));
+        if (matches == NULL) {
+            pthread_mutex_unlock(&pool->lock);
+            return -1;
+        }
+        search->matches = matches;
+        search->matches_cap = pool->found;
+    }
+    size_t at = search->n_matches ? search->matches[search->current] : 0;
+    size_t had = search->n_matches;
+    // the chunks are in order and so are the matches in each
+    size_t n = 0;
+    int complete = 1;
+    for (size_t i = 0; i < pool->n_chunks; i++) {
+        struct search_chunk *c = &pool->chunks[i];
+        memcpy(&search->matches[n], c->matches, c->n_matches * sizeof(size_t));
+        n += c->n_matches;
+        complete &= c->state == CHUNK_DONE;
+    }
+    pool->seen = pool->gen;
+    if (pool->woken) {
+        char drain[16];
+        while (read(pool->wake[0], drain, sizeof(drain)) > 0)
+            ;
+        pool->woken = 0;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    search->n_matches = n;
+    search->complete = complete;
+    if (had) {
+        // matches only ever come in, so the one the cursor was on is still there
+        size_t lo = 0, hi = n;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (search->matches[mid] < at)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        search->current = lo;
+    }
+    return 1;
+}
+
+int search_more(struct search *search) {
+    struct search_pool *old = search->pool;
+    if (old == NULL || search->complete)
+        return 0;
+    pool_reap(search, 0);
+    struct search_pool *pool = pool_new(old->doc, old->query, old->query_len, old->regex, old);
+    if (pool == NULL)
+        return -1;
+    pool_retire(search, old);
+    search->pool = pool;
+    size_t before = pool->found;
+    pool->limit = before + SEARCH_MAX_MATCHES;
+    if (pool_start(pool) != 0)
+        return -1;
+    pool_wait(pool, before);
+    return search_poll(search) < 0 ? -1 : 0;
+}
+
+void search_free(struct search *search) {
+    // the document may change once the search is over, so every worker has to be done
+    pool_free(search->pool);
+    pool_reap(search, 1);
+    if (search->regex) {
+        regex_free(search->regex);
+        free(search->regex);
+    }
+    free(search->query);
+    free(search->matches);
+    memset(search, 0, sizeof(*search));
+}
@@ -0,0 +1,62 @@
+#ifndef __SEARCH_H
+#define __SEARCH_H
+
+#include <stddef.h>
+
+#include "piece_table.h"
+#include "kilo_regex.h"
+
+#define SEARCH_MAX_MATCHES (1 << 16) // matches found before the workers stop for now
+#define SEARCH_LITERAL_MIN 3 // shortest literal in a regex worth finding lines with first
+#define SEARCH_CHUNK (1 << 20) // bytes of the document a worker takes at a time
+#define SEARCH_STEP (64 * 1024) // bytes a worker searches between checks on whether to stop
+#define SEARCH_MAX_WORKERS 8
+#define SEARCH_BATCH 256  // matches a worker finds before handing them over
+#define SEARCH_WAIT_MS 30 // how long search_update waits for the first match
+
+struct search_pool; // see search.c
+
+// The places a query occurs in the document as document offsets in ascending order, as
+// many as the workers have found so far. A literal query's matches may overlap, a regex's
+// don't.
+struct search {
+    char *query; // NULL when no search is on
+    size_t query_len;
+    struct regex *regex; // the query compiled, for a regex search
+    int bad_pattern;     // the query was meant as a regex but isn't one
+    size_t *matches;
+    size_t n_matches;
+    size_t matches_cap;
+    int complete;   // whether the workers got to the end, so n_matches is all of them
+    size_t current; // index in matches of the one the cursor is on
+    struct search_pool *pool;
+    struct search_pool *retired; // told to stop, and freed once their workers have
+};
+
+// Starts looking for query in doc, as a regex (see kilo_regex.h) if regex is set, telling
+// the workers of the last one to stop without waiting for them. The document is split into
+// chunks that a worker per core searches until there are SEARCH_MAX_MATCHES; what they find
+// comes in through search_poll, and this waits up to SEARCH_WAIT_MS for the first match.
+// When a literal query only adds to the end of the last one, that one's matches are checked
+// again and each chunk goes on from where it stopped. An empty query ends the search.
+// Returns -1 if malloc or pipe fails.
+int search_update(struct search *search, const struct piece_table *doc, const char *query, int regex);
+
+// Whether the workers have found anything that search_poll would add.
+int search_pending(struct search *search);
+
+// A file descriptor that polls readable while search_pending would be true, or -1 when no
+// search is on.
+int search_fd(struct search *search);
+
+// Puts what the workers have found so far into matches, keeping current on the same match.
+// Returns 1 if that changed anything, 0 if not and -1 if a worker's malloc failed.
+int search_poll(struct search *search);
+
+// Has the workers find up to SEARCH_MAX_MATCHES more, if they had stopped, waiting up to
+// SEARCH_WAIT_MS for the first. Returns -1 if malloc fails.
+int search_more(struct search *search);
+
+// Ends the search, waiting for every worker to stop, so the document can change after it.
+void search_free(struct search *search);
+#endif
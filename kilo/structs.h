@@ -5,14 +5,23 @@
 #include <time.h>
 #include <termios.h>
 
+#include "line_index.h"
+#include "piece_table.h"
+#include "row.h"
+#include "screen.h"
+#include "search.h"
+#include "undo.h"
+
+#define INPUT_BUF_SIZE 4096 // bytes of input read at once, see editor_read_key
+
 typedef struct e_row {
-    int idx;
     size_t size;
     char *chars;
-    size_t render_size;
-    char *render;
-    unsigned char *hl;
-    int hl_open_comment;
+    struct row_index index; // render columns and lexer states along the row
+    unsigned char *hl;      // highlight of chars[hl_from..hl_to), the part last drawn
+    size_t hl_from;
+    size_t hl_to;
+    int hl_valid;
 } e_row;
 
 struct editor_state {
@@ -25,12 +34,27 @@ struct editor_state {
     size_t row_offset;
     size_t column_offset;
     size_t n_rows;
-    e_row *row;
+    e_row **row;            // NULL for a row that isn't loaded, see editor_row
     char *filename;
     char status_msg[80];
     time_t status_time;
     int dirty;
     int last_key;
     struct editor_syntax *syntax;
+    struct piece_table doc; // the text itself; rows are kept in step with it
+    const char *map;        // the opened file, doc's original buffer
+    size_t map_len;
+    LineIndex lines;        // line starts in map
+    unsigned char *hl_state; // per line HL_STATE_* bits, see editor_highlight_to
+    size_t hl_frontier;      // lines above this all have an up to date hl_state
+    int lazy_rows;          // large file: rows are loaded when needed and evicted again
+    size_t *load_ring;      // row numbers in the order they were loaded, LAZY_ROW_CACHE of them
+    size_t load_ring_pos;
+    struct screen screen;   // the last frame written, see editor_refresh_screen
+    struct search search;   // matches of the query being typed, shown on every row
+    struct undo undo;       // every edit to doc, for Ctrl-Z and Ctrl-Y
+    char input[INPUT_BUF_SIZE]; // read but not yet decoded into keys
+    size_t input_pos;
+    size_t input_len;
 };
 #endif
\ No newline at end of file
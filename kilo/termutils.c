@@ -19,8 +19,9 @@ int get_cursor_pos(size_t *rows, size_t *cols) {
     char buf[32];
     unsigned int i = 0;
     if (write(STDOUT_FILENO, "\x1b[6n", 4) != 4) return -1;
+    struct pollfd in = { STDIN_FILENO, POLLIN, 0 };
     while (i < sizeof(buf) - 1) {
-        if (read(STDIN_FILENO, &buf[i], 1) != 1) break;
+        if (poll(&in, 1, CURSOR_POS_WAIT_MS) != 1 || read(STDIN_FILENO, &buf[i], 1) != 1) break;
         if (buf[i] == 'R') break;
         i++;
     }
@@ -33,6 +34,7 @@ int get_cursor_pos(size_t *rows, size_t *cols) {
 }
 
 void disable_raw_mode(struct editor_state *state) {
+    write(STDOUT_FILENO, "\x1b[?2004l", 8);
     if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &(state->orig_termios)) == -1)
         die("tcsetattr", state);
 }
@@ -45,10 +47,13 @@ void enable_raw_mode(struct editor_state *state) {
     raw.c_oflag &= ~(OPOST);
     raw.c_cflag |= (CS8);
     raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+    // reads return what is there without waiting; editor_read_key waits in poll()
     raw.c_cc[VMIN] = 0;
-    raw.c_cc[VTIME] = 1;
+    raw.c_cc[VTIME] = 0;
     if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) == -1)
         die("tcsetattr", state);
+    // bracketed paste: the terminal marks where a paste starts and ends, see editor_read_paste
+    write(STDOUT_FILENO, "\x1b[?2004h", 8);
 }
 
 void die(const char *msg, struct editor_state *state) {
@@ -68,12 +73,23 @@ void clean_exit(const char *msg, struct editor_state *state) {
 }
 
 void ab_append(struct abuf *ab, const char *s, int len) {
-    char *new = realloc(ab->b, ab->len + len);
-    if (new == NULL) return;
-    memcpy(&new[ab->len], s, len);
-    ab->b = new;
+    if (ab_reserve(ab, len) != 0) return;
+    memcpy(&ab->b[ab->len], s, len);
     ab->len += len;
 }
+
+// Makes room for len more bytes. Returns -1 if realloc fails.
+int ab_reserve(struct abuf *ab, int len) {
+    if (ab->len + len <= ab->cap) return 0;
+    int cap = ab->cap ? ab->cap * 2 : ABUF_INITIAL;
+    while (cap < ab->len + len) cap *= 2;
+    char *new = realloc(ab->b, cap);
+    if (new == NULL) return -1;
+    ab->b = new;
+    ab->cap = cap;
+    return 0;
+}
+
 void ab_free(struct abuf *ab) {
     free(ab->b);
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 #define __TERMUTILS_H
 #include "editor.h"
 
+#include <poll.h>
 #include <sys/ioctl.h>
 #include <stdlib.h>
 #include <string.h>
@@ -9,16 +10,7 @@
 #include <unistd.h>
 #include <termios.h>
 
-#define ABUF_INIT \
-    {             \
-        NULL, 0   \
-    }
-
-struct abuf
-{
-    char *b;
-    int len;
-};
+#define CURSOR_POS_WAIT_MS 100 // how long the terminal has to answer get_cursor_pos
 
 int get_window_size(struct editor_state *state);
 void enable_raw_mode(struct editor_state *state);
@@ -27,5 +19,6 @@ void disable_raw_mode(struct editor_state *state);
 void clean_exit(const char *msg, struct editor_state *state);
 void die(const char *msg, struct editor_state *state);
 void ab_append(struct abuf *ab, const char *s, int len);
+int ab_reserve(struct abuf *ab, int len);
 void ab_free(struct abuf *ab);
 #endif
\ No newline at end of file
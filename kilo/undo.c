@@ -0,0 +1,253 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "undo.h"
+
+// Ends every block in a spill file, so that the last one can be found from the end.
+struct undo_block {
+    size_t n;
+    size_t text_len;
+};
+
+static size_t stack_memory(const struct undo_stack *s) {
+    return s->n * sizeof(struct undo_record) + s->text_len;
+}
+
+static int reserve(struct undo_stack *s, size_t records, size_t text) {
+    if (s->n + records > s->cap) {
+        size_t cap = s->cap ? s->cap * 2 : 64;
+        while (cap < s->n + records)
+            cap *= 2;
+        struct undo_record *grown = realloc(s->records, cap * sizeof(struct undo_record));
+        if (grown == NULL)
+            return -1;
+        s->records = grown;
+        s->cap = cap;
+    }
+    if (s->text_len + text > s->text_cap) {
+        size_t cap = s->text_cap ? s->text_cap * 2 : 1024;
+        while (cap < s->text_len + text)
+            cap *= 2;
+        char *grown = realloc(s->text, cap);
+        if (grown == NULL)
+            return -1;
+        s->text = grown;
+        s->text_cap = cap;
+    }
+    return 0;
+}
+
+static int write_at(int fd, const void *buf, size_t len, size_t off) {
+    while (len > 0) {
+        ssize_t n = pwrite(fd, buf, len, off);
+        if (n <= 0)
+            return -1;
+        buf = (const char *) buf + n;
+        len -= n;
+        off += n;
+    }
+    return 0;
+}
+
+static int read_at(int fd, void *buf, size_t len, size_t off) {
+    while (len > 0) {
+        ssize_t n = pread(fd, buf, len, off);
+        if (n <= 0)
+            return -1;
+        buf = (char *) buf + n;
+        len -= n;
+        off += n;
+    }
+    return 0;
+}
+
+// Moves the oldest records out of memory, until no more than half of UNDO_MEMORY_CAP is
+// left, into a block at the end of the spill file. If the file can't be written they are
+// dropped, and so is everything older, which can't be undone without them.
+static void stack_spill(struct undo_stack *s) {
+    size_t k = 0;
+    size_t left = stack_memory(s);
+    while (k < s->n && left > UNDO_MEMORY_CAP / 2) {
+        left -= sizeof(struct undo_record) + s->records[k].len;
+        k++;
+    }
+    size_t text_len = k < s->n ? s->records[k].text : s->text_len;
+    size_t records_len = k * sizeof(struct undo_record);
+    struct undo_block block = { k, text_len };
+    if (s->spill == NULL)
+        s->spill = tmpfile();
+    int fd = s->spill ? fileno(s->spill) : -1;
+    if (fd != -1 && write_at(fd, s->records, records_len, s->spilled) == 0 &&
+        write_at(fd, s->text, text_len, s->spilled + records_len) == 0 &&
+        write_at(fd, &block, sizeof(block), s->spilled + records_len + text_len) == 0)
+        s->spilled += records_len + text_len + sizeof(block);
+    else
+        s->spilled = 0;
+    memmove(s->records, &s->records[k], (s->n - k) * sizeof(struct undo_record));
+    s->n -= k;
+    for (size_t i = 0; i < s->n; i++)
+        s->records[i].text -= text_len;
+    memmove(s->text, &s->text[text_len], s->text_len - text_len);
+    s->text_len -= text_len;
+}
+
+// Reads the newest block of the spill file back, once there is nothing left in memory.
+static int stack_reload(struct undo_stack *s) {
+    int fd = fileno(s->spill);
+    struct undo_block block;
+    if (read_at(fd, &block, sizeof(block), s->spilled - sizeof(block)) != 0)
+        return -1;
+    size_t records_len = block.n * sizeof(struct undo_record);
+    size_t start = s->spilled - sizeof(block) - block.text_len - records_len;
+    if (reserve(s, block.n, block.text_len) != 0 || read_at(fd, s->records, records_len, start) != 0 ||
+        read_at(fd, s->text, block.text_len, start + records_len) != 0)
+        return -1;
+    s->n = block.n;
+    s->text_len = block.text_len;
+    s->spilled = start;
+    return 0;
+}
+
+// Sets *top to the newest record, or NULL if there is none. Returns -1 if it had to be read
+// back from the spill file and couldn't be.
+static int stack_top(struct undo_stack *s, struct undo_record **top) {
+    if (s->n == 0 && s->spilled && stack_reload(s) != 0)
+        return -1;
+    *top = s->n ? &s->records[s->n - 1] : NULL;
+    return 0;
+}
+
+static int stack_push(struct undo_stack *s, const struct undo_record *r, const char *text) {
+    if (reserve(s, 1, r->len) != 0)
+        return -1;
+    s->records[s->n] = *r;
+    s->records[s->n].text = s->text_len;
+    memcpy(&s->text[s->text_len], text, r->len);
+    s->text_len += r->len;
+    s->n++;
+    if (stack_memory(s) > UNDO_MEMORY_CAP)
+        stack_spill(s);
+    return 0;
+}
+
+static void stack_pop(struct undo_stack *s) {
+    s->n--;
+    s->text_len = s->records[s->n].text;
+}
+
+// The spill file is kept, to be written over from the start.
+static void stack_clear(struct undo_stack *s) {
+    s->n = 0;
+    s->text_len = 0;
+    s->spilled = 0;
+}
+
+static void stack_free(struct undo_stack *s) {
+    free(s->records);
+    free(s->text);
+    if (s->spill)
+        fclose(s->spill);
+    memset(s, 0, sizeof(*s));
+}
+
+void undo_begin(struct undo *u, size_t x, size_t y) {
+    u->step++;
+    u->x = x;
+    u->y = y;
+}
+
+int undo_record(struct undo *u, enum undo_type type, size_t pos, const char *text, size_t len) {
+    if (len == 0)
+        return 0;
+    if (u->undone.n || u->undone.spilled)
+        stack_clear(&u->undone);
+    struct undo_stack *s = &u->done;
+    struct undo_record *top = s->n ? &s->records[s->n - 1] : NULL;
+    int typing = len == 1 && text[0] != '\n';
+    // a byte typed or deleted next to the one the last key did joins its record
+    if (typing && top && top->typing && top->type == type && top->step + 1 == u->step && top->len < UNDO_MERGE_MAX) {
+        int append = type == UNDO_INSERT ? pos == top->pos + top->len : pos == top->pos;
+        int prepend = type == UNDO_DELETE && pos + 1 == top->pos; // backspace
+        if (append || prepend) {
+            if (reserve(s, 0, 1) != 0)
+                return -1;
+            char *at = &s->text[top->text];
+            if (prepend) {
+                memmove(at + 1, at, top->len);
+                at[0] = text[0];
+                top->pos = pos;
+            }
+            else {
+                at[top->len] = text[0];
+            }
+            top->len++;
+            top->step = u->step;
+            s->text_len++;
+            return 0;
+        }
+    }
+    struct undo_record r = { pos, len, 0, u->x, u->y, u->x, u->y, u->step, type, typing };
+    return stack_push(s, &r, text);
+}
+
+void undo_end(struct undo *u, size_t x, size_t y) {
+    struct undo_stack *s = &u->done;
+    if (s->n && s->records[s->n - 1].step == u->step) {
+        s->records[s->n - 1].after_x = x;
+        s->records[s->n - 1].after_y = y;
+    }
+}
+
+// Moves the top step of from onto to, applying each of its records as it goes: as they
+// were for redo, the other way round for undo.
+static int move_step(struct undo_stack *from, struct undo_stack *to, int redo,
+                     int (*apply)(void *arg, enum undo_type type, size_t pos, const char *text, size_t len),
+                     void *arg, size_t *x, size_t *y) {
+    struct undo_record *top;
+    if (stack_top(from, &top) != 0)
+        return -1;
+    if (top == NULL)
+        return 0;
+    unsigned long step = top->step;
+    while (top && top->step == step) {
+        enum undo_type type = top->type;
+        if (!redo)
+            type = type == UNDO_INSERT ? UNDO_DELETE : UNDO_INSERT;
+        const char *text = &from->text[top->text];
+        if (apply(arg, type, top->pos, text, top->len) != 0)
+            return -1;
+        *x = redo ? top->after_x : top->before_x;
+        *y = redo ? top->after_y : top->before_y;
+        if (stack_push(to, top, text) != 0)
+            return -1;
+        stack_pop(from);
+        if (stack_top(from, &top) != 0)
+            return -1;
+    }
+    return 1;
+}
+
+int undo_undo(struct undo *u, int (*apply)(void *arg, enum undo_type type, size_t pos, const char *text, size_t len),
+              void *arg, size_t *x, size_t *y) {
+    return move_step(&u->done, &u->undone, 0, apply, arg, x, y);
+}
+
+int undo_redo(struct undo *u, int (*apply)(void *arg, enum undo_type type, size_t pos, const char *text, size_t len),
+              void *arg, size_t *x, size_t *y) {
+    return move_step(&u->undone, &u->done, 1, apply, arg, x, y);
+}
+
+size_t undo_memory(const struct undo *u) {
+    return stack_memory(&u->done) + stack_memory(&u->undone);
+}
+
+size_t undo_spilled(const struct undo *u) {
+    return u->done.spilled + u->undone.spilled;
+}
+
+void undo_free(struct undo *u) {
+    stack_free(&u->done);
+    stack_free(&u->undone);
+    u->step = 0;
+}
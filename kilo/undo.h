@@ -0,0 +1,80 @@
+#ifndef __UNDO_H
+#define __UNDO_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+/*
+   Undo and redo as a log of the edits themselves: every record is bytes inserted into or
+   deleted from the document at an offset, plus where the cursor was, so undoing one costs
+   as much as the edit did and the document is never copied. Typing and deleting one byte
+   after another go into the same record. Each stack keeps up to UNDO_MEMORY_CAP bytes of
+   history in memory and writes its oldest records out to a temporary file beyond that,
+   reading them back when undo gets to them.
+*/
+
+#define UNDO_MEMORY_CAP (4 << 20) // bytes of records and text a stack keeps in memory
+#define UNDO_MERGE_MAX 1024        // longest run of typing that one record takes in
+
+enum undo_type {
+    UNDO_INSERT = 1,
+    UNDO_DELETE,
+};
+
+struct undo_record {
+    size_t pos;  // document offset of the edit
+    size_t len;  // bytes inserted or deleted
+    size_t text; // where those bytes are in the stack's text
+    size_t before_x, before_y; // cursor before the key that made the edit
+    size_t after_x, after_y;   // and after it
+    unsigned long step;        // every edit made by one key has the same step
+    unsigned char type;
+    unsigned char typing; // one typed or deleted byte, or a run of them, which more can join
+};
+
+// Records with the oldest at the bottom, those that didn't fit in memory in spill.
+struct undo_stack {
+    struct undo_record *records;
+    size_t n;
+    size_t cap;
+    char *text;
+    size_t text_len;
+    size_t text_cap;
+    FILE *spill;    // blocks of records, each followed by its text and a struct undo_block
+    size_t spilled; // bytes of spill in use
+};
+
+struct undo {
+    struct undo_stack done;   // what undo takes back, the newest edit on top
+    struct undo_stack undone; // what redo does again, the next one on top
+    unsigned long step;
+    size_t x, y; // cursor when the step began
+};
+
+// Starts a step: the edits until the next one are undone and redone together. (x, y) is
+// the cursor.
+void undo_begin(struct undo *u, size_t x, size_t y);
+
+// Records len bytes of text being inserted or deleted at pos, and forgets what could have
+// been redone. Returns -1 if malloc fails.
+int undo_record(struct undo *u, enum undo_type type, size_t pos, const char *text, size_t len);
+
+// Ends the step with the cursor at (x, y).
+void undo_end(struct undo *u, size_t x, size_t y);
+
+// Takes back the last step that is left, calling apply with each edit that does so, and
+// sets (*x, *y) to where the cursor was before it. Returns 1 if there was one, 0 if not
+// and -1 if apply fails or the spill file can't be read.
+int undo_undo(struct undo *u, int (*apply)(void *arg, enum undo_type type, size_t pos, const char *text, size_t len),
+              void *arg, size_t *x, size_t *y);
+
+// Does again the last step that was undone, the same way.
+int undo_redo(struct undo *u, int (*apply)(void *arg, enum undo_type type, size_t pos, const char *text, size_t len),
+              void *arg, size_t *x, size_t *y);
+
+// Bytes of history kept in memory and in the spill files.
+size_t undo_memory(const struct undo *u);
+size_t undo_spilled(const struct undo *u);
+
+void undo_free(struct undo *u);
+#endif
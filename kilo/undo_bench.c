@@ -0,0 +1,194 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "line_index.h"
+#include "piece_table.h"
+#include "undo.h"
+
+/*
+   A long editing session on a BENCH_FILE_SIZE document with every edit going into the undo
+   log the way kilo does it: mostly typing and backspacing, now and then a newline, a jump
+   somewhere else in the file, or a block pasted or cut. Every BENCH_KEYS / 10 keys it prints
+   how big the history is, against what one record per key without merging would take, and
+   the time per key spent in the undo log, the piece table left out:
+
+       keys,memory_kb,spilled_kb,unmerged_kb,rss_mb,log_ns_per_key
+
+   then undoes the whole session, checks the document is what it was, redoes it and checks
+   it is what it was after the session. seconds is all of it, log_ns_per_step again leaves
+   out the piece table:
+
+       edit,steps,seconds,log_ns_per_step
+
+   Usage: ./undo_bench [file_mb] [keys]
+*/
+
+#define BENCH_FILE_SIZE (100UL * 1024 * 1024)
+#define BENCH_LINE_LEN 64
+#define BENCH_KEYS 1000000
+#define BENCH_BLOCK_MAX 4096
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long rss_kb() {
+    FILE *f = fopen("/proc/self/status", "r");
+    char line[256];
+    long kb = 0;
+    while (f && fgets(line, sizeof(line), f)) {
+        if (strncmp(line, "VmRSS:", 6) == 0)
+            kb = atol(&line[6]);
+    }
+    if (f)
+        fclose(f);
+    return kb;
+}
+
+static double in_log;   // seconds spent recording edits
+static double in_apply; // seconds undo and redo spent applying them to the piece table
+
+static int apply(void *arg, enum undo_type type, size_t pos, const char *text, size_t len) {
+    struct piece_table *pt = arg;
+    double t = now();
+    int r = type == UNDO_INSERT ? piece_table_insert(pt, pos, text, len) : piece_table_delete(pt, pos, len);
+    in_apply += now() - t;
+    return r;
+}
+
+static int record(struct undo *u, enum undo_type type, size_t pos, const char *text, size_t len) {
+    double t = now();
+    int r = undo_record(u, type, pos, text, len);
+    in_log += now() - t;
+    return r;
+}
+
+static void insert(struct undo *u, struct piece_table *pt, size_t pos, const char *s, size_t len) {
+    if (record(u, UNDO_INSERT, pos, s, len) != 0 || piece_table_insert(pt, pos, s, len) != 0) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+}
+
+static void delete(struct undo *u, struct piece_table *pt, size_t pos, size_t len, char *buf) {
+    piece_table_read(pt, pos, len, buf);
+    if (record(u, UNDO_DELETE, pos, buf, len) != 0 || piece_table_delete(pt, pos, len) != 0) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+}
+
+// Whether pt holds exactly the len bytes of want.
+static int same(const struct piece_table *pt, const char *want, size_t len, char *buf) {
+    return pt->len == len && piece_table_read(pt, 0, len, buf) == len && memcmp(buf, want, len) == 0;
+}
+
+int main(int argc, char *argv[]) {
+    size_t size = argc > 1 ? strtoull(argv[1], NULL, 10) * 1024 * 1024 : BENCH_FILE_SIZE;
+    size_t keys = argc > 2 ? strtoull(argv[2], NULL, 10) : BENCH_KEYS;
+
+    char *file = malloc(size);
+    char *block = malloc(BENCH_BLOCK_MAX);
+    if (file == NULL || block == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    for (size_t i = 0; i < size; i++) file[i] = (i % BENCH_LINE_LEN == BENCH_LINE_LEN - 1) ? '\n' : 'a' + i % 26;
+    LineIndex lines;
+    struct piece_table pt;
+    if (line_index_build(&lines, file, size, '\n', 0) != 0 || piece_table_init(&pt, file, size, lines.offsets, lines.count) != 0) {
+        fprintf(stderr, "could not index the file\n");
+        return 1;
+    }
+    struct undo u = { 0 };
+    size_t cursor = size / 2;
+    size_t unmerged = 0;
+    srand(1);
+
+    printf("keys,memory_kb,spilled_kb,unmerged_kb,rss_mb,log_ns_per_key\n");
+    size_t every = keys / 10 ? keys / 10 : 1;
+    for (size_t k = 1; k <= keys; k++) {
+        undo_begin(&u, cursor, 0);
+        int r = rand() % 100;
+        if (r < 70) {
+            char c = 'a' + rand() % 26;
+            insert(&u, &pt, cursor++, &c, 1);
+            unmerged += sizeof(struct undo_record) + 1;
+        }
+        else if (r < 85 && cursor > 0) {
+            delete(&u, &pt, --cursor, 1, block);
+            unmerged += sizeof(struct undo_record) + 1;
+        }
+        else if (r < 90) {
+            insert(&u, &pt, cursor++, "\n", 1);
+            unmerged += sizeof(struct undo_record) + 1;
+        }
+        else if (r < 98) {
+            cursor = (size_t) rand() * rand() % pt.len;
+        }
+        else {
+            size_t len = 1 + rand() % BENCH_BLOCK_MAX;
+            if (r == 98) {
+                memset(block, 'p', len);
+                insert(&u, &pt, cursor, block, len);
+            }
+            else {
+                if (len > pt.len - cursor)
+                    len = pt.len - cursor;
+                delete(&u, &pt, cursor, len, block);
+            }
+            unmerged += sizeof(struct undo_record) + len;
+        }
+        undo_end(&u, cursor, 0);
+        if (k % every == 0) {
+            printf("%zu,%zu,%zu,%zu,%ld,%.1f\n", k, undo_memory(&u) / 1024, undo_spilled(&u) / 1024, unmerged / 1024,
+                   rss_kb() / 1024, in_log * 1e9 / every);
+            fflush(stdout);
+            in_log = 0;
+        }
+    }
+
+    char *edited = malloc(pt.len);
+    char *buf = malloc(pt.len > size ? pt.len : size);
+    if (edited == NULL || buf == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    size_t edited_len = piece_table_read(&pt, 0, pt.len, edited);
+
+    printf("edit,steps,seconds,log_ns_per_step\n");
+    size_t x, y, steps = 0;
+    in_apply = 0;
+    double t = now();
+    int r;
+    while ((r = undo_undo(&u, apply, &pt, &x, &y)) == 1) steps++;
+    t = now() - t;
+    printf("undo_all,%zu,%.4f,%.1f\n", steps, t, steps ? (t - in_apply) * 1e9 / steps : 0);
+    if (r < 0 || !same(&pt, file, size, buf)) {
+        fprintf(stderr, "undoing everything did not give back the original\n");
+        return 1;
+    }
+    steps = 0;
+    in_apply = 0;
+    t = now();
+    while ((r = undo_redo(&u, apply, &pt, &x, &y)) == 1) steps++;
+    t = now() - t;
+    printf("redo_all,%zu,%.4f,%.1f\n", steps, t, steps ? (t - in_apply) * 1e9 / steps : 0);
+    if (r < 0 || !same(&pt, edited, edited_len, buf)) {
+        fprintf(stderr, "redoing everything did not give back the edited document\n");
+        return 1;
+    }
+    undo_free(&u);
+    piece_table_free(&pt);
+    line_index_free(&lines);
+    free(file);
+    free(block);
+    free(edited);
+    free(buf);
+    return 0;
+}
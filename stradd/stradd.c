@@ -1,45 +1,139 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <stdbool.h>
-#define MAX_STR_SIZE 128
-
-char* concat_strings(char* str1, char* str2, bool strip_last_char) {
-    size_t str1_len, str2_len;
-    str1_len = strlen(str1);
-    str2_len = strlen(str2);   
-    size_t new_len = str1_len + str2_len + 1;
-    char* concatenation = malloc(new_len);
-    strncpy(concatenation, str1, str1_len);
-    strncat(concatenation, str2, str2_len);
-
-    return concatenation;
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+
+/*
+   Concatenates files to stdout, like cat. "-" or no arguments at all reads stdin. Inputs can
+   be any size: nothing is held in memory but one copy buffer, and when both ends allow it the
+   kernel moves the data itself without it passing through this process. Throughput is
+   reported on stderr.
+
+   Usage: ./stradd [file|-]...
+*/
+
+#define COPY_BUFFER_SIZE (1024 * 1024)
+#define TRANSFER_MAX (1024 * 1024 * 1024) // bytes asked for per kernel transfer call
+
+enum copy_method { COPY_FILE_RANGE, COPY_SENDFILE, COPY_SPLICE, COPY_BUFFERED, COPY_METHODS };
+static const char* method_names[COPY_METHODS] = { "copy_file_range", "sendfile", "splice", "read/write" };
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
 }
 
-int main() {
-    char *str1 = malloc(MAX_STR_SIZE);
-    char *str2 = malloc(MAX_STR_SIZE);
+// The errors a kernel transfer gives when it can't be used between these two fds at all.
+static int unsupported(int err) {
+    return err == EINVAL || err == EXDEV || err == ENOSYS || err == EBADF || err == EOPNOTSUPP;
+}
 
-    printf("Maximum allowed length is %i\n", MAX_STR_SIZE);
+// Moves everything left in in_fd to out_fd with one kind of kernel transfer, adding the bytes
+// moved to copied. Returns 0 when in_fd hit EOF, 1 if the method doesn't work for these fds
+// (the next one carries on from wherever it stopped) and -1 on error.
+static int transfer(enum copy_method method, int in_fd, int out_fd, size_t* copied) {
+    for (;;) {
+        ssize_t ret;
+        if (method == COPY_FILE_RANGE) ret = copy_file_range(in_fd, NULL, out_fd, NULL, TRANSFER_MAX, 0);
+        else if (method == COPY_SENDFILE) ret = sendfile(out_fd, in_fd, NULL, TRANSFER_MAX);
+        else ret = splice(in_fd, NULL, out_fd, NULL, TRANSFER_MAX, SPLICE_F_MOVE | SPLICE_F_MORE);
 
-    printf("Enter a string: ");
-    if (fgets(str1, MAX_STR_SIZE, stdin) == NULL) {
-        goto error_cleanup;
+        if (ret == 0) return 0;
+        if (ret > 0) {
+            *copied += ret;
+            continue;
+        }
+        if (errno == EINTR) continue;
+        if (unsupported(errno)) return 1;
+        return -1;
     }
-    
-    printf("Enter another string: ");
-    if (fgets(str2, MAX_STR_SIZE, stdin) == NULL) {
-        goto error_cleanup;
+}
+
+static int copy_buffered(int in_fd, int out_fd, char* buf, size_t* copied) {
+    for (;;) {
+        ssize_t len = read(in_fd, buf, COPY_BUFFER_SIZE);
+        if (len == 0) return 0;
+        if (len < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        ssize_t done = 0;
+        while (done < len) {
+            ssize_t ret = write(out_fd, buf + done, len - done);
+            if (ret < 0) {
+                if (errno == EINTR) continue;
+                return -1;
+            }
+            done += ret;
+        }
+        *copied += len;
+    }
+}
+
+// Copies in_fd to out_fd with the cheapest method both ends allow, adding the bytes each
+// method moved to method_bytes. Returns -1 on error.
+static int copy_fd(int in_fd, int out_fd, char* buf, size_t method_bytes[COPY_METHODS]) {
+    struct stat in_st, out_st;
+    if (fstat(in_fd, &in_st) == -1 || fstat(out_fd, &out_st) == -1) return -1;
+
+    enum copy_method tries[3];
+    int count = 0;
+    if (S_ISREG(in_st.st_mode) && S_ISREG(out_st.st_mode)) tries[count++] = COPY_FILE_RANGE;
+    if (S_ISREG(in_st.st_mode)) tries[count++] = COPY_SENDFILE;
+    if (S_ISFIFO(in_st.st_mode) || S_ISFIFO(out_st.st_mode)) tries[count++] = COPY_SPLICE;
+
+    for (int i = 0; i < count; i++) {
+        int ret = transfer(tries[i], in_fd, out_fd, &method_bytes[tries[i]]);
+        if (ret != 1) return ret;
     }
-    
-    printf("concatenated strings: %s\n", concat_strings(str1, str2, true));
-    
-    free(str1);
-    free(str2);
-    return 0;
-
-    error_cleanup:
-        free(str1);
-        free(str2);
+    return copy_buffered(in_fd, out_fd, buf, &method_bytes[COPY_BUFFERED]);
+}
+
+int main(int argc, char* argv[]) {
+    char* buf = malloc(COPY_BUFFER_SIZE);
+    if (buf == NULL) {
+        fprintf(stderr, "stradd: out of memory\n");
         return 1;
+    }
+    const char* stdin_only[] = { "-" };
+    const char** inputs = argc > 1 ? (const char**) &argv[1] : stdin_only;
+    int input_count = argc > 1 ? argc - 1 : 1;
+
+    size_t method_bytes[COPY_METHODS] = {0};
+    int status = 0;
+    double start = now();
+    for (int i = 0; i < input_count; i++) {
+        int use_stdin = strcmp(inputs[i], "-") == 0;
+        int fd = use_stdin ? STDIN_FILENO : open(inputs[i], O_RDONLY);
+        if (fd == -1) {
+            fprintf(stderr, "stradd: %s: %s\n", inputs[i], strerror(errno));
+            status = 1;
+            continue;
+        }
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        if (copy_fd(fd, STDOUT_FILENO, buf, method_bytes) == -1) {
+            fprintf(stderr, "stradd: %s: %s\n", use_stdin ? "stdin" : inputs[i], strerror(errno));
+            status = 1;
+        }
+        if (!use_stdin) close(fd);
+    }
+    double elapsed = now() - start;
+    size_t total = 0;
+    for (int m = 0; m < COPY_METHODS; m++) total += method_bytes[m];
+
+    fprintf(stderr, "stradd: %zu bytes in %.3f s (%.2f GB/s)", total, elapsed,
+            elapsed > 0 ? total / elapsed / 1e9 : 0.0);
+    for (int m = 0; m < COPY_METHODS; m++) {
+        if (method_bytes[m]) fprintf(stderr, ", %s %zu", method_names[m], method_bytes[m]);
+    }
+    fprintf(stderr, "\n");
+    free(buf);
+    return status;
 }